@@ -21,7 +21,22 @@
 #include <cstdlib>
 #include <cstddef>
 #include <cassert>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <limits>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <algorithm>
 #include <vector>
+#include <future>
+#include <iterator>
+#include <functional>
+#include <type_traits>
 #include <unordered_map>
 #include <stdexcept>
 #include "fflerror.h"
@@ -37,6 +52,21 @@
 // aligned_alloc is not standardized for compiler with c++14
 #define SCOPED_ALLOC_USE_POSIX_MEMALIGN
 
+// support arenas backed by mmap() and fd based I/O, needs POSIX
+// undef it on platforms without <sys/mman.h>
+#define SCOPED_ALLOC_SUPPORT_MMAP
+
+#ifdef SCOPED_ALLOC_SUPPORT_MMAP
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
 namespace scoped_alloc
 {
     constexpr bool is_power2(size_t n)
@@ -61,7 +91,7 @@ namespace scoped_alloc
 #endif
     }
 
-    template<size_t Alignment> size_t aligned_size(size_t byte_count) noexcept
+    template<size_t Alignment> constexpr size_t aligned_size(size_t byte_count) noexcept
     {
         static_assert(check_alignment(Alignment), "bad alignment");
         return (byte_count + (Alignment - 1)) & ~(Alignment - 1);
@@ -142,6 +172,156 @@ namespace scoped_alloc
         }
     }
 
+#ifdef SCOPED_ALLOC_SUPPORT_MMAP
+    inline void writev_all(int fd, struct iovec *iov, size_t count)
+    {
+        // keep calling writev() until all data written
+        // iov gets modified for partial write
+
+        while(count > 0){
+            const auto n = ::writev(fd, iov, static_cast<int>(std::min<size_t>(count, IOV_MAX)));
+            if(n < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                throw fflerror("writev(%d) failed: %s", fd, std::strerror(errno));
+            }
+
+            auto done = static_cast<size_t>(n);
+            while(count > 0 && done >= iov->iov_len){
+                done -= iov->iov_len;
+                iov++;
+                count--;
+            }
+
+            if(count > 0){
+                iov->iov_base = static_cast<char *>(iov->iov_base) + done;
+                iov->iov_len -= done;
+            }
+        }
+    }
+
+    inline size_t readv_all(int fd, struct iovec *iov, size_t count)
+    {
+        // keep calling readv() until all buffers filled or end of file
+        // returns bytes read, iov gets modified for partial read
+
+        size_t byte_count = 0;
+        while(count > 0){
+            const auto n = ::readv(fd, iov, static_cast<int>(std::min<size_t>(count, IOV_MAX)));
+            if(n < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                throw fflerror("readv(%d) failed: %s", fd, std::strerror(errno));
+            }
+
+            if(n == 0){
+                break;
+            }
+
+            auto done = static_cast<size_t>(n);
+            byte_count += done;
+
+            while(count > 0 && done >= iov->iov_len){
+                done -= iov->iov_len;
+                iov++;
+                count--;
+            }
+
+            if(count > 0){
+                iov->iov_base = static_cast<char *>(iov->iov_base) + done;
+                iov->iov_len -= done;
+            }
+        }
+        return byte_count;
+    }
+
+    inline void read_all(int fd, void *buf, size_t byte_count)
+    {
+        auto p = static_cast<char *>(buf);
+        while(byte_count > 0){
+            const auto n = ::read(fd, p, byte_count);
+            if(n < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                throw fflerror("read(%d) failed: %s", fd, std::strerror(errno));
+            }
+
+            if(n == 0){
+                throw fflerror("read(%d) reaches end of file, %zu bytes missing", fd, byte_count);
+            }
+
+            p          += n;
+            byte_count -= static_cast<size_t>(n);
+        }
+    }
+
+    class iovec_list
+    {
+        // scatter-gather list for readv()/writev()
+        // doesn't own the memory of its entries
+
+        private:
+            std::vector<struct iovec> m_iov;
+            size_t m_byte_count = 0;
+
+        public:
+            void add(void *p, size_t byte_count)
+            {
+                m_iov.push_back({p, byte_count});
+                m_byte_count += byte_count;
+            }
+
+            void clear()
+            {
+                m_iov.clear();
+                m_byte_count = 0;
+            }
+
+        public:
+            const struct iovec *data() const
+            {
+                return m_iov.data();
+            }
+
+            size_t size() const
+            {
+                return m_iov.size();
+            }
+
+            size_t byte_count() const
+            {
+                return m_byte_count;
+            }
+
+        public:
+            const struct iovec *begin() const
+            {
+                return m_iov.data();
+            }
+
+            const struct iovec *end() const
+            {
+                return m_iov.data() + m_iov.size();
+            }
+
+        public:
+            void writev(int fd) const
+            {
+                auto iov = m_iov;
+                scoped_alloc::writev_all(fd, iov.data(), iov.size());
+            }
+
+            size_t readv(int fd) const
+            {
+                auto iov = m_iov;
+                return scoped_alloc::readv_all(fd, iov.data(), iov.size());
+            }
+    };
+#endif
+
     template<size_t Alignment> class dynamic_buf
     {
         // helper class with ownship
@@ -196,11 +376,17 @@ namespace scoped_alloc
             }
     };
 
+    template<size_t Alignment> class child_arena;
+    template<class T, size_t Alignment> class arena_deleter;
+
     template<size_t Alignment = alignof(std::max_align_t)> class arena_interf
     {
         private:
             static_assert(check_alignment(Alignment), "bad alignment");
 
+        public:
+            constexpr static size_t alignment = Alignment;
+
         private:
             char  *m_buf  = nullptr;
             size_t m_size = 0;
@@ -208,6 +394,27 @@ namespace scoped_alloc
         private:
             char *m_cursor = nullptr;
 
+        private:
+            size_t m_high_water = 0;
+            size_t m_fallback_bytes = 0;
+
+        private:
+            // end of bottom allocation, blocks above it are taken from top, see double_ended_arena
+            // always aligned, tail of buffer less than Alignment is not usable anyway
+            char *m_end = nullptr;
+
+        private:
+            struct dtor_node
+            {
+                // destructor thunk of object created by make()
+                // lives in front of the object
+
+                void (*dtor)(void *);
+                dtor_node *next;
+                size_t byte_count;
+            };
+            dtor_node *m_dtor_list = nullptr;
+
         protected:
             template<size_t BufAlignment> void set_buf(const aligned_buf<BufAlignment> &buf)
             {
@@ -219,6 +426,22 @@ namespace scoped_alloc
                 m_cursor = buf.buf;
                 m_buf    = buf.buf;
                 m_size   = buf.size;
+                m_end    = buf_end();
+            }
+
+        protected:
+            void clear_buf()
+            {
+                m_cursor = nullptr;
+                m_buf    = nullptr;
+                m_size   = 0;
+                m_end    = nullptr;
+            }
+
+        private:
+            char *buf_end() const
+            {
+                return m_buf + m_size / Alignment * Alignment;
             }
 
         public:
@@ -260,9 +483,13 @@ namespace scoped_alloc
         public:
             virtual ~arena_interf()
             {
+                // derived class releasing the buffer should call destroy_objects() before that
+                destroy_objects();
+
                 m_cursor = nullptr;
                 m_buf    = nullptr;
                 m_size   = 0;
+                m_end    = nullptr;
             }
 
         public:
@@ -277,9 +504,112 @@ namespace scoped_alloc
                 return (static_cast<size_t>(m_cursor - buf.buf) * 1.0f) / buf.size;
             }
 
-            void reset()
+            virtual void reset()
             {
+                destroy_objects();
                 m_cursor = get_buf_ex().buf;
+                m_end    = buf_end();
+            }
+
+        protected:
+            void set_used(size_t byte_count)
+            {
+                // restore cursor for buffer with existing content
+                // used by arenas whose buffer outlives the process
+
+                const auto buf = get_buf_ex();
+                if(byte_count > static_cast<size_t>(m_end - buf.buf)){
+                    throw fflerror("invalid used byte count: %zu, buffer size: %zu", byte_count, buf.size);
+                }
+                m_cursor = buf.buf + byte_count;
+            }
+
+        public:
+            size_t high_water() const
+            {
+                // peak of used() plus live fallback bytes over arena lifetime, not cleared by reset()
+                return m_high_water;
+            }
+
+            size_t fallback_bytes() const
+            {
+                // bytes currently allocated by dynamic_alloc() and not freed yet
+                return m_fallback_bytes;
+            }
+
+            size_t demand() const
+            {
+                // buffer size to take the same allocations without fallback
+                return high_water();
+            }
+
+        protected:
+            void add_fallback(size_t byte_count)
+            {
+                // derived class allocating out of buffer by itself, not by default dynamic_alloc(), should count it here
+                // memory owned by the arena, i.e. new chunk or window, is not fallback
+                m_fallback_bytes += scoped_alloc::aligned_size<Alignment>(byte_count);
+                update_high_water();
+            }
+
+            void sub_fallback(size_t byte_count) noexcept
+            {
+                m_fallback_bytes -= std::min<size_t>(m_fallback_bytes, scoped_alloc::aligned_size<Alignment>(byte_count));
+            }
+
+        private:
+            void update_high_water() noexcept
+            {
+                m_high_water = std::max<size_t>(m_high_water, static_cast<size_t>(m_cursor - m_buf) + m_fallback_bytes);
+            }
+
+        protected:
+            char *top_begin() const
+            {
+                return m_end;
+            }
+
+            size_t top_used() const
+            {
+                return static_cast<size_t>(buf_end() - m_end);
+            }
+
+            void set_top_used(size_t byte_count)
+            {
+                // rewind top allocation, byte_count comes from top_used()
+                if(byte_count > top_used()){
+                    throw fflerror("invalid top used byte count: %zu, current: %zu", byte_count, top_used());
+                }
+                m_end = buf_end() - byte_count;
+            }
+
+            template<size_t RequestAlignment> char *allocate_top(size_t byte_count)
+            {
+                // allocate from top of buffer downwards
+                // falls back to dynamic_alloc() as allocate() does, caller should return it by deallocate()
+
+                static_assert(check_alignment(RequestAlignment) && (RequestAlignment <= Alignment), "bad requested alignment");
+                detect_outlive();
+
+                if(byte_count == 0){
+                    return nullptr;
+                }
+
+                get_buf_ex(); // throw if no buffer
+                const auto byte_count_aligned = scoped_alloc::aligned_size<Alignment>(byte_count);
+
+                if(static_cast<decltype(byte_count_aligned)>(m_end - m_cursor) >= byte_count_aligned){
+                    m_end -= byte_count_aligned;
+                    return m_end;
+                }
+                return dynamic_alloc(byte_count);
+            }
+
+        public:
+            bool owns(const char *p) const
+            {
+                // p points into current buffer
+                return has_buf() && m_buf <= p && p < m_buf + m_size;
             }
 
         protected:
@@ -302,12 +632,13 @@ namespace scoped_alloc
                     return nullptr;
                 }
 
-                const auto buf = get_buf_ex();
+                get_buf_ex(); // throw if no buffer
                 const auto byte_count_aligned = scoped_alloc::aligned_size<Alignment>(byte_count);
 
-                if(static_cast<decltype(byte_count_aligned)>(buf.buf + buf.size - m_cursor) >= byte_count_aligned){
+                if(static_cast<decltype(byte_count_aligned)>(m_end - m_cursor) >= byte_count_aligned){
                     auto r = m_cursor;
                     m_cursor += byte_count_aligned;
+                    update_high_water();
                     return r;
                 }
 
@@ -321,12 +652,77 @@ namespace scoped_alloc
                 return dynamic_alloc(byte_count);
             }
 
+        private:
+            static size_t dtor_node_size()
+            {
+                return scoped_alloc::aligned_size<Alignment>(sizeof(dtor_node));
+            }
+
+        public:
+            template<typename T, typename... Args> T *make(Args && ... args)
+            {
+                // construct object in arena, no ownership tracking needed by caller
+                // non-trivially destructible object gets a destructor thunk in front of it
+                // reset() and arena destruction run the thunks in reverse order of construction
+
+                // trivially destructible object needs no thunk if it's in buffer, reset() rewinds it
+                // if it falls back to heap, retry with a node, then reset() releases it
+
+                if(std::is_trivially_destructible<T>::value){
+                    const auto p = allocate<alignof(T)>(sizeof(T));
+                    if(owns(p)){
+                        return new (p) T(std::forward<Args>(args)...);
+                    }
+                    deallocate(p, sizeof(T));
+                }
+
+                const auto byte_count = dtor_node_size() + sizeof(T);
+                const auto p = allocate<alignof(T)>(byte_count);
+
+                T *t = nullptr;
+                try{
+                    t = new (p + dtor_node_size()) T(std::forward<Args>(args)...);
+                }
+                catch(...){
+                    deallocate(p, byte_count);
+                    throw;
+                }
+
+                m_dtor_list = new (p) dtor_node
+                {
+                    [](void *obj)
+                    {
+                        static_cast<T *>(obj)->~T();
+                    },
+
+                    m_dtor_list,
+                    byte_count,
+                };
+                return t;
+            }
+
+        protected:
+            void destroy_objects() noexcept
+            {
+                while(m_dtor_list){
+                    const auto node = m_dtor_list;
+                    const auto byte_count = node->byte_count;
+
+                    m_dtor_list = node->next;
+                    node->dtor(reinterpret_cast<char *>(node) + dtor_node_size());
+                    deallocate(reinterpret_cast<char *>(node), byte_count);
+                }
+            }
+
         public:
             void deallocate(char *p, size_t byte_count) noexcept
             {
                 detect_outlive();
 
-                if(in_buf(p)){
+                // not in_buf(), a block starting at the buffer end is not ours
+                // i.e. child_arena overflow placed by parent right after the child region
+
+                if(owns(p)){
                     if(p + scoped_alloc::aligned_size<Alignment>(byte_count) == m_cursor){
                         m_cursor = p;
                     }
@@ -338,14 +734,64 @@ namespace scoped_alloc
                 }
 
                 else{
-                    scoped_alloc::free_aligned(p);
+                    dynamic_free(p, byte_count);
+                }
+            }
+
+#ifdef SCOPED_ALLOC_SUPPORT_MMAP
+        public:
+            virtual void append_used_iovec(scoped_alloc::iovec_list &list) const
+            {
+                // append used regions of the arena to list
+                // arenas with more than one region should override it
+                // memory allocated by dynamic_alloc() is not included
+
+                if(has_buf() && used()){
+                    list.add(m_buf, used());
+                }
+            }
+
+            scoped_alloc::iovec_list used_iovec() const
+            {
+                // write the arena with one writev()/sendmsg() without copying
+                scoped_alloc::iovec_list list;
+                append_used_iovec(list);
+                return list;
+            }
+#endif
+
+        public:
+            std::unique_ptr<scoped_alloc::child_arena<Alignment>, scoped_alloc::arena_deleter<scoped_alloc::child_arena<Alignment>, Alignment>> sub_arena(size_t byte_count)
+            {
+                // child arena carved from this arena, child object itself also lives in this arena
+                // region goes back to this arena when the child is destroyed on top
+                using child_type = scoped_alloc::child_arena<Alignment>;
+                using deleter_type = scoped_alloc::arena_deleter<child_type, Alignment>;
+
+                const auto p = allocate<alignof(child_type)>(sizeof(child_type));
+                try{
+                    return std::unique_ptr<child_type, deleter_type>(new (p) child_type(*this, byte_count), deleter_type(*this, sizeof(child_type)));
+                }
+                catch(...){
+                    deallocate(p, sizeof(child_type));
+                    throw;
                 }
             }
 
         public:
             virtual char *dynamic_alloc(size_t byte_count)
             {
-                return scoped_alloc::alloc_aligned<Alignment>(byte_count).buf;
+                const auto p = scoped_alloc::alloc_aligned<Alignment>(byte_count).buf;
+                add_fallback(byte_count);
+                return p;
+            }
+
+            virtual void dynamic_free(char *p, size_t byte_count) noexcept
+            {
+                // release memory not in current buffer
+                // should match dynamic_alloc() if derived class overrides it
+                scoped_alloc::free_aligned(p);
+                sub_fallback(byte_count);
             }
 
         private:
@@ -373,6 +819,12 @@ namespace scoped_alloc
             {
                 this->set_buf(scoped_alloc::aligned_buf<Alignment>{m_storage, ByteCount});
             }
+
+        public:
+            ~fixed_arena() override
+            {
+                this->destroy_objects();
+            }
     };
 
     template<size_t Alignment = alignof(std::max_align_t)> class dynamic_arena: public scoped_alloc::arena_interf<Alignment>
@@ -396,6 +848,12 @@ namespace scoped_alloc
             ~dynamic_arena() override
             {
                 if(this->has_buf()){
+#ifdef SCOPED_ALLOC_SUPPORT_MMAP
+                    if(m_frozen){
+                        protect(PROT_READ | PROT_WRITE, false);
+                    }
+#endif
+                    this->destroy_objects();
                     scoped_alloc::free_aligned(this->get_buf().buf);
                 }
             }
@@ -464,69 +922,3179 @@ namespace scoped_alloc
 #ifdef SCOPED_ALLOC_DISABLE_DYNAMIC_ARENA_REALLOC
                     throw fflerror("dynamic_arena has buffer attached");
 #else
+#ifdef SCOPED_ALLOC_SUPPORT_MMAP
+                    thaw();
+#endif
+                    this->destroy_objects();
                     scoped_alloc::free_aligned(this->get_buf().buf);
 #endif
                 }
                 this->set_buf(scoped_alloc::alloc_aligned<Alignment>(byte_count));
             }
-    };
-
-    template<class T, size_t Alignment = alignof(std::max_align_t)> class allocator
-    {
-        public:
-            using value_type = T;
-            template <class U, size_t A> friend class scoped_alloc::allocator;
 
-        public:
-            template <class UpperType> struct rebind
+            void release()
             {
-                using other = allocator<UpperType, Alignment>;
-            };
-
-        private:
-            arena_interf<Alignment> &m_arena;
-
-        public:
-            allocator(const allocator &) = default;
-            allocator &operator=(const allocator &) = delete;
+                // free the buffer, alloc() can be called again afterwards
+                // caller confirms no container refers to the buffer any more, see the comment of alloc()
 
-        public:
-            allocator(arena_interf<Alignment> &arena_ref) noexcept
-                : m_arena(arena_ref)
-            {}
+                if(!this->has_buf()){
+                    return;
+                }
 
-        public:
-            template<class U> allocator(const allocator<U, Alignment>& alloc_ref) noexcept
-                : m_arena(alloc_ref.m_arena)
-            {}
+#ifdef SCOPED_ALLOC_SUPPORT_MMAP
+                thaw();
+#endif
+                this->destroy_objects();
+                scoped_alloc::free_aligned(this->get_buf().buf);
+                this->clear_buf();
+            }
 
-        public:
-            T* allocate(size_t n)
+#ifdef SCOPED_ALLOC_SUPPORT_MMAP
+        private:
+            struct snapshot_header
             {
-                return reinterpret_cast<T *>(m_arena.template allocate<alignof(T)>(n * sizeof(T)));
-            }
+                uint64_t magic;
+                uint64_t alignment;
+                uint64_t size;
+                uint64_t used;
+            };
 
-            void deallocate(T *p, size_t n) noexcept
+            static uint64_t snapshot_magic()
             {
-                m_arena.deallocate(reinterpret_cast<char *>(p), n * sizeof(T));
+                return 0x31544f4e50414e53; // "SNAPNOT1"
             }
 
         public:
-            template<typename T2, size_t A2> bool operator == (const scoped_alloc::allocator<T2, A2> &parm) noexcept
+            void snapshot(int fd) const
             {
-                return Alignment == A2 && &(this->m_arena) == &(parm.m_arena);
+                // write used prefix of the buffer to fd with one writev()
+                // content is restored byte-wise, pointers inside are only valid if relocatable, see offset_ptr
+                // memory allocated by dynamic_alloc() is not included
+
+                const auto buf = this->get_buf_ex();
+                snapshot_header hdr
+                {
+                    snapshot_magic(),
+                    Alignment,
+                    buf.size,
+                    this->used(),
+                };
+
+                struct iovec iov[]
+                {
+                    {&hdr, sizeof(hdr)},
+                    {buf.buf, this->used()},
+                };
+                scoped_alloc::writev_all(fd, iov, std::extent<decltype(iov)>::value);
             }
 
-            template<typename T2, size_t A2> bool operator != (const scoped_alloc::allocator<T2, A2> &parm) noexcept
+            void restore(int fd)
             {
-                return !(*this == parm);
-            }
-    };
+                // restore a snapshot from fd
+                // allocate buffer of the snapshot size if no buffer attached
 
-    template<typename Key, typename Value, size_t Alignment = alignof(std::max_align_t), typename KeyHash = std::hash<Key>, typename KeyEq = std::equal_to<Key>> class hash_wrapper
-    {
-        private:
-            scoped_alloc::dynamic_arena<Alignment> m_arena;
+                if(m_frozen){
+                    throw fflerror("restore frozen dynamic_arena");
+                }
+
+                snapshot_header hdr;
+                scoped_alloc::read_all(fd, &hdr, sizeof(hdr));
+
+                if(hdr.magic != snapshot_magic()){
+                    throw fflerror("fd %d is not a dynamic_arena snapshot", fd);
+                }
+
+                if(hdr.alignment != Alignment || hdr.used > hdr.size){
+                    throw fflerror("incompatible snapshot: alignment = %zu, size = %zu, used = %zu", static_cast<size_t>(hdr.alignment), static_cast<size_t>(hdr.size), static_cast<size_t>(hdr.used));
+                }
+
+                if(!this->has_buf()){
+                    alloc(hdr.size);
+                }
+
+                else if(this->get_buf().size < hdr.used){
+                    throw fflerror("snapshot needs %zu bytes, buffer size: %zu", static_cast<size_t>(hdr.used), this->get_buf().size);
+                }
+
+                // snapshot is valid, objects created by make() are going to be overwritten
+                this->destroy_objects();
+                scoped_alloc::read_all(fd, this->get_buf().buf, hdr.used);
+                this->set_used(hdr.used);
+            }
+
+        private:
+            bool m_frozen = false;
+            bool m_dontfork = false;
+
+        private:
+            bool protect(int prot, bool throw_on_error)
+            {
+                // mprotect() works on pages, only whole pages inside the buffer are covered
+                // returns false if buffer has no whole page
+
+                const auto page_size = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+                const auto buf = this->get_buf_ex();
+
+                const auto begin = (reinterpret_cast<uintptr_t>(buf.buf) + page_size - 1) & ~(page_size - 1);
+                const auto end   = (reinterpret_cast<uintptr_t>(buf.buf) + buf.size) & ~(page_size - 1);
+
+                if(begin >= end){
+                    return false;
+                }
+
+                if(::mprotect(reinterpret_cast<void *>(begin), end - begin, prot) && throw_on_error){
+                    throw fflerror("mprotect(%p, %zu) failed: %s", reinterpret_cast<void *>(begin), static_cast<size_t>(end - begin), std::strerror(errno));
+                }
+
+                if(m_dontfork && ::madvise(reinterpret_cast<void *>(begin), end - begin, m_frozen ? MADV_DOFORK : MADV_DONTFORK) && throw_on_error){
+                    throw fflerror("madvise(%p, %zu) failed: %s", reinterpret_cast<void *>(begin), static_cast<size_t>(end - begin), std::strerror(errno));
+                }
+                return true;
+            }
+
+        public:
+            void freeze(bool dontfork = false)
+            {
+                // make the buffer read-only, any write afterwards raises SIGSEGV immediately
+                // forked children then share the frozen pages copy-on-write without accidental copies
+                //
+                // only whole pages inside the buffer get protected
+                // use page size as Alignment to cover the entire buffer
+                //
+                // dontfork applies MADV_DONTFORK, children won't see the buffer at all
+
+                if(m_frozen){
+                    return;
+                }
+
+                m_dontfork = dontfork;
+                protect(PROT_READ, true);
+                m_frozen = true;
+            }
+
+            void thaw()
+            {
+                if(!m_frozen){
+                    return;
+                }
+
+                protect(PROT_READ | PROT_WRITE, true);
+                m_frozen   = false;
+                m_dontfork = false;
+            }
+
+            bool frozen() const
+            {
+                return m_frozen;
+            }
+#endif
+    };
+
+    template<size_t Alignment = alignof(std::max_align_t)> class measure_arena: public scoped_alloc::arena_interf<Alignment>
+    {
+        // measure how many bytes a sequence of allocations takes in an arena
+        // every allocation goes to heap and gets counted, nothing is recycled by rewinding
+        //
+        // replay the allocations, i.e. copy a container with allocator of this arena
+        // then measured() is enough for a dynamic_arena to take the same allocations without fallback
+
+        private:
+            alignas(Alignment) char m_storage[Alignment];
+
+        private:
+            size_t m_measured = 0;
+
+        public:
+            measure_arena(): scoped_alloc::arena_interf<Alignment>()
+            {
+                // exhausted buffer, all allocations go to dynamic_alloc()
+                this->set_buf(scoped_alloc::aligned_buf<Alignment>{m_storage, Alignment});
+                this->set_used(Alignment);
+            }
+
+        public:
+            size_t measured() const
+            {
+                return m_measured;
+            }
+
+        public:
+            void reset() override
+            {
+                this->destroy_objects();
+                m_measured = 0;
+            }
+
+        public:
+            char *dynamic_alloc(size_t byte_count) override
+            {
+                m_measured += scoped_alloc::aligned_size<Alignment>(byte_count);
+                return scoped_alloc::arena_interf<Alignment>::dynamic_alloc(byte_count);
+            }
+    };
+
+    template<size_t N, size_t Alignment = alignof(std::max_align_t)> class multi_buffered_arena
+    {
+        // ring of N dynamic_arenas for frame based loops
+        // allocations of frame K stay valid till N - 1 more flip()s, no manual reset() needed
+        //
+        //     scoped_alloc::double_buffered_arena<> frames(1024 * 1024);
+        //     while(running){
+        //         frames.flip();
+        //         build(frames.current(), frames.previous());     // frame N + 1 reads frame N
+        //     }
+
+        private:
+            static_assert(N >= 2, "multi_buffered_arena needs at least two buffers");
+
+        private:
+            scoped_alloc::dynamic_arena<Alignment> m_arenas[N];
+
+        private:
+            size_t m_current = 0;
+
+        public:
+            multi_buffered_arena(size_t byte_count = 0)
+            {
+                if(byte_count){
+                    for(auto &arena: m_arenas){
+                        arena.alloc(byte_count);
+                    }
+                }
+            }
+
+        public:
+            scoped_alloc::dynamic_arena<Alignment> &current()
+            {
+                return m_arenas[m_current];
+            }
+
+            scoped_alloc::dynamic_arena<Alignment> &previous(size_t back = 1)
+            {
+                if(back >= N){
+                    throw fflerror("invalid frame: back = %zu, buffers = %zu", back, N);
+                }
+                return m_arenas[(m_current + N - back) % N];
+            }
+
+        public:
+            scoped_alloc::dynamic_arena<Alignment> &flip()
+            {
+                // oldest frame gets recycled as the new current frame
+                m_current = (m_current + 1) % N;
+                if(m_arenas[m_current].has_buf()){
+                    m_arenas[m_current].reset();
+                }
+                return m_arenas[m_current];
+            }
+
+        public:
+            constexpr static size_t buffers()
+            {
+                return N;
+            }
+    };
+
+    template<size_t Alignment = alignof(std::max_align_t)> using double_buffered_arena = scoped_alloc::multi_buffered_arena<2, Alignment>;
+
+    template<size_t Alignment = alignof(std::max_align_t)> class child_arena: public scoped_alloc::arena_interf<Alignment>
+    {
+        // arena bump allocates inside a region taken from parent arena
+        // gives nested component its own budget and stats without another heap buffer
+        // allocations exceeding the region overflow to parent, counted by overflow()
+        //
+        // region is returned to parent when child is destroyed and the region is on top of parent
+        // otherwise it's reclaimed when parent resets
+        //
+        //     scoped_alloc::dynamic_arena<> parent(1 << 20);
+        //     {
+        //         scoped_alloc::child_arena<> child(parent, 4096);     // or: auto child = parent.sub_arena(4096);
+        //         std::vector<int, scoped_alloc::allocator<int>> v(child);
+        //         ...
+        //     }
+
+        private:
+            scoped_alloc::arena_interf<Alignment> &m_parent;
+
+        private:
+            size_t m_overflow = 0;
+
+        public:
+            child_arena(scoped_alloc::arena_interf<Alignment> &parent, size_t byte_count)
+                : scoped_alloc::arena_interf<Alignment>()
+                , m_parent(parent)
+            {
+                if(!byte_count){
+                    throw fflerror("bad argument: byte_count = 0");
+                }
+
+                const auto byte_count_aligned = scoped_alloc::aligned_size<Alignment>(byte_count);
+                this->set_buf(scoped_alloc::aligned_buf<Alignment>{m_parent.template allocate<Alignment>(byte_count_aligned), byte_count_aligned});
+            }
+
+        public:
+            ~child_arena() override
+            {
+                const auto buf = this->get_buf();
+
+                this->destroy_objects();
+                this->clear_buf();
+                m_parent.deallocate(buf.buf, buf.size);
+            }
+
+        public:
+            scoped_alloc::arena_interf<Alignment> &parent() const
+            {
+                return m_parent;
+            }
+
+            size_t overflow() const
+            {
+                // bytes currently overflowed to parent
+                return m_overflow;
+            }
+
+        public:
+            char *dynamic_alloc(size_t byte_count) override
+            {
+                auto p = m_parent.template allocate<Alignment>(byte_count);
+                m_overflow += scoped_alloc::aligned_size<Alignment>(byte_count);
+                this->add_fallback(byte_count);
+                return p;
+            }
+
+            void dynamic_free(char *p, size_t byte_count) noexcept override
+            {
+                m_overflow -= scoped_alloc::aligned_size<Alignment>(byte_count);
+                m_parent.deallocate(p, byte_count);
+                this->sub_fallback(byte_count);
+            }
+    };
+
+    class memory_quota
+    {
+        // byte budget shared by arenas of one tenant, quotas nest as a tree
+        // a charge goes to the quota and all its ancestors, fails if any of them exceeds hard limit
+        //
+        // soft callback fires when usage crosses soft limit upwards, caller can start shedding load
+        // hard callback fires when a charge is refused, the allocation then throws
+        // limit 0 means no limit
+        //
+        //     scoped_alloc::memory_quota process(0, 8 << 30);
+        //     scoped_alloc::memory_quota tenant(&process, 512 << 20, 1 << 30);
+        //
+        //     tenant.on_soft([](const scoped_alloc::memory_quota &, size_t){ start_shedding(); });
+        //     scoped_alloc::budget_arena<> a(tenant, 1 << 20);
+
+        public:
+            using callback_type = std::function<void(const memory_quota &, size_t)>;
+
+        private:
+            memory_quota * const m_parent;
+
+        private:
+            const size_t m_soft;
+            const size_t m_hard;
+
+        private:
+            std::atomic<size_t> m_used {0};
+
+        private:
+            callback_type m_on_soft;
+            callback_type m_on_hard;
+
+        public:
+            memory_quota(size_t soft, size_t hard)
+                : memory_quota(nullptr, soft, hard)
+            {}
+
+            memory_quota(memory_quota *parent, size_t soft, size_t hard)
+                : m_parent(parent)
+                , m_soft(soft)
+                , m_hard(hard)
+            {
+                if(m_soft && m_hard && m_soft > m_hard){
+                    throw fflerror("invalid quota: soft = %zu, hard = %zu", m_soft, m_hard);
+                }
+            }
+
+        public:
+            memory_quota(memory_quota &&) = delete;
+            memory_quota(const memory_quota &) = delete;
+            memory_quota &operator = (memory_quota &&) = delete;
+            memory_quota &operator = (const memory_quota &) = delete;
+
+        public:
+            void on_soft(callback_type f)
+            {
+                // not thread safe, set before the quota is shared
+                m_on_soft = std::move(f);
+            }
+
+            void on_hard(callback_type f)
+            {
+                m_on_hard = std::move(f);
+            }
+
+        public:
+            memory_quota *parent() const
+            {
+                return m_parent;
+            }
+
+            size_t used() const
+            {
+                return m_used.load(std::memory_order_relaxed);
+            }
+
+            size_t soft_limit() const
+            {
+                return m_soft;
+            }
+
+            size_t hard_limit() const
+            {
+                return m_hard;
+            }
+
+            bool over_soft() const
+            {
+                return m_soft && used() > m_soft;
+            }
+
+        public:
+            bool try_charge(size_t byte_count)
+            {
+                // charge this quota and all ancestors, all or nothing
+                for(auto q = this; q; q = q->m_parent){
+                    const auto prev = q->m_used.fetch_add(byte_count, std::memory_order_relaxed);
+                    if(q->m_hard && prev + byte_count > q->m_hard){
+                        q->m_used.fetch_sub(byte_count, std::memory_order_relaxed);
+                        for(auto r = this; r != q; r = r->m_parent){
+                            r->m_used.fetch_sub(byte_count, std::memory_order_relaxed);
+                        }
+
+                        if(q->m_on_hard){
+                            q->m_on_hard(*q, byte_count);
+                        }
+                        return false;
+                    }
+
+                    if(q->m_soft && prev <= q->m_soft && prev + byte_count > q->m_soft && q->m_on_soft){
+                        q->m_on_soft(*q, byte_count);
+                    }
+                }
+                return true;
+            }
+
+            void charge(size_t byte_count)
+            {
+                if(!try_charge(byte_count)){
+                    throw fflerror("memory quota exceeded: byte_count = %zu", byte_count);
+                }
+            }
+
+            void release(size_t byte_count) noexcept
+            {
+                for(auto q = this; q; q = q->m_parent){
+                    q->m_used.fetch_sub(byte_count, std::memory_order_relaxed);
+                }
+            }
+    };
+
+    template<size_t Alignment = alignof(std::max_align_t)> class budget_arena: public scoped_alloc::arena_interf<Alignment>
+    {
+        // arena accounts its buffer and all fallback allocations against a memory_quota
+        // allocation refused by quota throws, containers see it as allocation failure
+
+        private:
+            scoped_alloc::memory_quota &m_quota;
+
+        private:
+            size_t m_fallback = 0;
+
+        public:
+            budget_arena(scoped_alloc::memory_quota &quota, size_t byte_count)
+                : scoped_alloc::arena_interf<Alignment>()
+                , m_quota(quota)
+            {
+                const auto byte_count_aligned = scoped_alloc::aligned_size<Alignment>(byte_count);
+                m_quota.charge(byte_count_aligned);
+
+                try{
+                    this->set_buf(scoped_alloc::alloc_aligned<Alignment>(byte_count_aligned));
+                }
+                catch(...){
+                    m_quota.release(byte_count_aligned);
+                    throw;
+                }
+            }
+
+        public:
+            ~budget_arena() override
+            {
+                const auto buf = this->get_buf();
+
+                this->destroy_objects();
+                this->clear_buf();
+
+                scoped_alloc::free_aligned(buf.buf);
+                m_quota.release(buf.size);
+            }
+
+        public:
+            scoped_alloc::memory_quota &quota() const
+            {
+                return m_quota;
+            }
+
+            size_t fallback() const
+            {
+                // bytes currently allocated out of buffer
+                return m_fallback;
+            }
+
+        public:
+            char *dynamic_alloc(size_t byte_count) override
+            {
+                const auto byte_count_aligned = scoped_alloc::aligned_size<Alignment>(byte_count);
+                m_quota.charge(byte_count_aligned);
+
+                try{
+                    auto p = scoped_alloc::arena_interf<Alignment>::dynamic_alloc(byte_count);
+                    m_fallback += byte_count_aligned;
+                    return p;
+                }
+                catch(...){
+                    m_quota.release(byte_count_aligned);
+                    throw;
+                }
+            }
+
+            void dynamic_free(char *p, size_t byte_count) noexcept override
+            {
+                const auto byte_count_aligned = scoped_alloc::aligned_size<Alignment>(byte_count);
+                scoped_alloc::arena_interf<Alignment>::dynamic_free(p, byte_count);
+
+                m_fallback -= byte_count_aligned;
+                m_quota.release(byte_count_aligned);
+            }
+    };
+
+    class arena_profile
+    {
+        // arena sizes observed by name, persisted across runs
+        // text file, one "name bytes" per line, name has no whitespace
+        //
+        //     scoped_alloc::arena_profile profile("arena.profile");   // loads if exists, saves when destroyed
+        //     {
+        //         scoped_alloc::profiled_arena<> a(profile, "request", 4096);
+        //         ...
+        //     }
+        //
+        // next run sizes "request" arena by its demand() of this run
+
+        private:
+            const std::string m_path;
+
+        private:
+            mutable std::mutex m_lock;
+            std::unordered_map<std::string, size_t> m_sizes;
+            std::unordered_map<std::string, size_t> m_observed;
+
+        private:
+            bool m_dirty = false;
+
+        public:
+            explicit arena_profile(std::string path)
+                : m_path(std::move(path))
+            {
+                if(m_path.empty()){
+                    throw fflerror("empty profile path");
+                }
+
+                if(auto fp = std::fopen(m_path.c_str(), "r")){
+                    char name[256];
+                    size_t byte_count = 0;
+
+                    while(std::fscanf(fp, "%255s %zu", name, &byte_count) == 2){
+                        m_sizes[name] = byte_count;
+                    }
+                    std::fclose(fp);
+                }
+            }
+
+        public:
+            ~arena_profile()
+            {
+                try{
+                    save();
+                }
+                catch(...){
+                    // profile is only a hint
+                }
+            }
+
+        public:
+            arena_profile(arena_profile &&) = delete;
+            arena_profile(const arena_profile &) = delete;
+            arena_profile &operator = (arena_profile &&) = delete;
+            arena_profile &operator = (const arena_profile &) = delete;
+
+        public:
+            size_t size_hint(const std::string &name, size_t byte_count) const
+            {
+                // saved size, or byte_count if name is not in profile
+                const std::lock_guard<std::mutex> lock(m_lock);
+                const auto p = m_sizes.find(name);
+                return (p != m_sizes.end()) ? p->second : byte_count;
+            }
+
+            void record(const std::string &name, size_t byte_count)
+            {
+                // name longer than 255 chars can't be read back by "%255s" in loader
+                if(name.empty() || name.size() > 255 || std::any_of(name.begin(), name.end(), [](char ch){ return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r'; })){
+                    throw fflerror("invalid profile name: \"%s\"", name.c_str());
+                }
+
+                // several arenas can share a name, keep the largest of this run
+                // value loaded from last run is replaced, not merged, so the profile can shrink
+
+                const std::lock_guard<std::mutex> lock(m_lock);
+                auto &observed = m_observed[name];
+
+                observed = std::max<size_t>(observed, byte_count);
+                m_sizes[name] = observed;
+                m_dirty = true;
+            }
+
+        public:
+            void save()
+            {
+                const std::lock_guard<std::mutex> lock(m_lock);
+                if(!m_dirty){
+                    return;
+                }
+
+                // write a temp file and rename, a crash never leaves a truncated profile
+                const auto tmp_path = m_path + ".tmp";
+                auto fp = std::fopen(tmp_path.c_str(), "w");
+
+                if(!fp){
+                    throw fflerror("failed to open profile: %s", tmp_path.c_str());
+                }
+
+                for(const auto &p: m_sizes){
+                    std::fprintf(fp, "%s %zu\n", p.first.c_str(), p.second);
+                }
+
+                if(std::fclose(fp) || std::rename(tmp_path.c_str(), m_path.c_str())){
+                    throw fflerror("failed to save profile: %s", m_path.c_str());
+                }
+                m_dirty = false;
+            }
+    };
+
+    template<size_t Alignment = alignof(std::max_align_t)> class profiled_arena: public scoped_alloc::dynamic_arena<Alignment>
+    {
+        // dynamic_arena sized by arena_profile, records its demand() back when destroyed
+        // profile must outlive the arena
+
+        private:
+            scoped_alloc::arena_profile &m_profile;
+            const std::string m_name;
+
+        private:
+            static size_t buf_size(const scoped_alloc::arena_profile &profile, const std::string &name, size_t byte_count)
+            {
+                // saved 0 means nothing allocated last run, treat as no entry, same as hash_wrapper
+                // otherwise arena gets no buffer and keeps recording 0
+                const auto hint = profile.size_hint(name, 0);
+                return hint ? hint : byte_count;
+            }
+
+        public:
+            profiled_arena(scoped_alloc::arena_profile &profile, std::string name, size_t byte_count)
+                : scoped_alloc::dynamic_arena<Alignment>(buf_size(profile, name, byte_count))
+                , m_profile(profile)
+                , m_name(std::move(name))
+            {}
+
+        public:
+            ~profiled_arena() override
+            {
+                try{
+                    m_profile.record(m_name, this->demand());
+                }
+                catch(...){
+                    // profile is only a hint
+                }
+            }
+    };
+
+    template<size_t Alignment = alignof(std::max_align_t)> class growing_arena: public scoped_alloc::arena_interf<Alignment>
+    {
+        // arena grows by chunks, old chunks are kept till reset()
+        // when usage of current chunk crosses watermark, next chunk is allocated and pretouched by a background thread
+        // the allocation reaching end of chunk then only switches buffer, no page fault or malloc on the hot path
+        //
+        // watermark 1.0 disables background preparation, next chunk is allocated when needed
+        // allocation larger than chunk size goes to heap directly
+        //
+        // reset() keeps the first chunk and a prepared chunk if any, releases all others
+
+        private:
+            struct chunk
+            {
+                char  *buf;
+                size_t size;
+                size_t used;
+            };
+
+        private:
+            const size_t m_chunk_size;
+            const float  m_watermark;
+
+        private:
+            std::vector<chunk> m_chunks;
+
+        private:
+            std::future<scoped_alloc::aligned_buf<Alignment>> m_next;
+
+        public:
+            growing_arena(size_t chunk_size, float watermark = 0.8f)
+                : scoped_alloc::arena_interf<Alignment>()
+                , m_chunk_size(scoped_alloc::aligned_size<Alignment>(chunk_size))
+                , m_watermark(watermark)
+            {
+                if(!chunk_size){
+                    throw fflerror("bad argument: chunk_size = 0");
+                }
+
+                if(!(watermark > 0.0f && watermark <= 1.0f)){
+                    throw fflerror("bad argument: watermark = %f", watermark);
+                }
+                use_chunk(scoped_alloc::alloc_aligned<Alignment>(m_chunk_size));
+            }
+
+        public:
+            ~growing_arena() override
+            {
+                this->destroy_objects();
+                this->clear_buf();
+
+                drop_next();
+                for(const auto &c: m_chunks){
+                    scoped_alloc::free_aligned(c.buf);
+                }
+            }
+
+        public:
+            size_t chunks() const
+            {
+                return m_chunks.size();
+            }
+
+            size_t chunk_size() const
+            {
+                return m_chunk_size;
+            }
+
+            bool preparing() const
+            {
+                return m_next.valid();
+            }
+
+        public:
+            void reset() override
+            {
+                this->destroy_objects();
+
+                auto first = m_chunks.front();
+                for(size_t i = 1; i < m_chunks.size(); ++i){
+                    scoped_alloc::free_aligned(m_chunks[i].buf);
+                }
+
+                m_chunks.clear();
+                use_chunk(scoped_alloc::aligned_buf<Alignment>{first.buf, first.size});
+            }
+
+#ifdef SCOPED_ALLOC_SUPPORT_MMAP
+        public:
+            void append_used_iovec(scoped_alloc::iovec_list &list) const override
+            {
+                for(size_t i = 0; i + 1 < m_chunks.size(); ++i){
+                    if(m_chunks[i].used){
+                        list.add(m_chunks[i].buf, m_chunks[i].used);
+                    }
+                }
+                scoped_alloc::arena_interf<Alignment>::append_used_iovec(list);
+            }
+#endif
+
+        public:
+            char *dynamic_alloc(size_t byte_count) override
+            {
+                if(scoped_alloc::aligned_size<Alignment>(byte_count) > m_chunk_size){
+                    return scoped_alloc::arena_interf<Alignment>::dynamic_alloc(byte_count);
+                }
+
+                if(this->top_used()){
+                    // crossed watermark, give the reserved tail back and prepare next chunk
+                    this->set_top_used(0);
+                    prepare_next();
+                    return this->template allocate<Alignment>(byte_count);
+                }
+
+                m_chunks.back().used = this->used();
+                use_chunk(take_next());
+                return this->template allocate<Alignment>(byte_count);
+            }
+
+            void dynamic_free(char *p, size_t byte_count) noexcept override
+            {
+                // memory in old chunks is reclaimed by reset()
+                for(const auto &c: m_chunks){
+                    if(c.buf <= p && p < c.buf + c.size){
+                        return;
+                    }
+                }
+                scoped_alloc::arena_interf<Alignment>::dynamic_free(p, byte_count);
+            }
+
+        private:
+            void use_chunk(const scoped_alloc::aligned_buf<Alignment> &buf)
+            {
+                m_chunks.push_back({buf.buf, buf.size, 0});
+                this->set_buf(buf);
+
+                // reserve tail above watermark by top allocation
+                // allocation reaching it goes to dynamic_alloc(), which starts preparing next chunk
+
+                const auto reserved = buf.size - static_cast<size_t>(buf.size * m_watermark) / Alignment * Alignment;
+                if(reserved && reserved < buf.size){
+                    this->template allocate_top<Alignment>(reserved);
+                }
+            }
+
+            void prepare_next()
+            {
+                if(m_next.valid()){
+                    return;
+                }
+
+#ifdef SCOPED_ALLOC_SUPPORT_MMAP
+                const auto page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#else
+                const size_t page_size = 4096;
+#endif
+                m_next = std::async(std::launch::async, [byte_count = m_chunk_size, page_size]()
+                {
+                    // touch one byte per page, page faults happen in background
+                    const auto buf = scoped_alloc::alloc_aligned<Alignment>(byte_count);
+                    for(size_t off = 0; off < buf.size; off += page_size){
+                        buf.buf[off] = 0;
+                    }
+                    return buf;
+                });
+            }
+
+            scoped_alloc::aligned_buf<Alignment> take_next()
+            {
+                if(m_next.valid()){
+                    return m_next.get();
+                }
+                return scoped_alloc::alloc_aligned<Alignment>(m_chunk_size);
+            }
+
+            void drop_next() noexcept
+            {
+                if(m_next.valid()){
+                    try{
+                        scoped_alloc::free_aligned(m_next.get().buf);
+                    }
+                    catch(...){
+                        // background allocation failed, nothing to release
+                    }
+                }
+            }
+    };
+
+    template<size_t Alignment = alignof(std::max_align_t), size_t MaxBlockSize = 4096> class recycle_arena: public scoped_alloc::arena_interf<Alignment>
+    {
+        // per-thread arena recycles freed blocks by power-of-2 size classes, blocks can be freed by any thread
+        // owner thread allocates and frees through plain free lists, no atomic operation
+        // other threads push freed blocks to a lock-free MPSC stack, owner takes the whole stack in one exchange
+        // when a free list runs empty, or by reclaim()
+        //
+        // use it with scoped_alloc::allocator<T, Alignment, recycle_arena<Alignment>>
+        // allocate()/deallocate() of recycle_arena hide the ones in arena_interf, calling through arena_interf & is not thread safe
+        //
+        // blocks larger than MaxBlockSize are not recycled, they are rewound or released as arena_interf does
+        // owner thread is the constructing thread, only the owner allocates
+
+        private:
+            struct free_node
+            {
+                free_node *next;
+                size_t byte_count;
+            };
+
+        private:
+            constexpr static size_t min_block_size()
+            {
+                return scoped_alloc::aligned_size<Alignment>(sizeof(free_node));
+            }
+
+            constexpr static size_t class_count()
+            {
+                size_t count = 1;
+                for(size_t size = min_block_size(); size < MaxBlockSize; size *= 2){
+                    count++;
+                }
+                return count;
+            }
+
+        private:
+            static_assert(is_power2(MaxBlockSize) && MaxBlockSize >= min_block_size(), "bad max block size");
+
+        private:
+            const std::thread::id m_owner;
+
+        private:
+            free_node *m_free[class_count()] = {};
+            std::atomic<free_node *> m_remote {nullptr};
+
+        public:
+            recycle_arena(size_t byte_count)
+                : scoped_alloc::arena_interf<Alignment>()
+                , m_owner(std::this_thread::get_id())
+            {
+                this->set_buf(scoped_alloc::alloc_aligned<Alignment>(byte_count));
+            }
+
+        public:
+            ~recycle_arena() override
+            {
+                const auto buf = this->get_buf();
+
+                this->destroy_objects();
+                release_free_lists();
+
+                this->clear_buf();
+                scoped_alloc::free_aligned(buf.buf);
+            }
+
+        public:
+            bool owner() const
+            {
+                return std::this_thread::get_id() == m_owner;
+            }
+
+        public:
+            template<size_t RequestAlignment> char *allocate(size_t byte_count)
+            {
+                static_assert(check_alignment(RequestAlignment) && (RequestAlignment <= Alignment), "bad requested alignment");
+                assert(owner() && "recycle_arena allocates in non-owner thread");
+
+                if(byte_count == 0){
+                    return nullptr;
+                }
+
+                if(byte_count > MaxBlockSize){
+                    return scoped_alloc::arena_interf<Alignment>::template allocate<Alignment>(byte_count);
+                }
+
+                const auto index = class_index(byte_count);
+                if(!m_free[index]){
+                    reclaim();
+                }
+
+                if(const auto node = m_free[index]){
+                    m_free[index] = node->next;
+                    return reinterpret_cast<char *>(node);
+                }
+                return scoped_alloc::arena_interf<Alignment>::template allocate<Alignment>(class_size(index));
+            }
+
+            void deallocate(char *p, size_t byte_count) noexcept
+            {
+                if(!p){
+                    return;
+                }
+
+                if(owner()){
+                    local_free(p, byte_count);
+                }
+
+                else{
+                    // push to MPSC stack, owner pops all at once so no ABA
+                    const auto node = new (p) free_node{m_remote.load(std::memory_order_relaxed), byte_count};
+                    while(!m_remote.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)){
+                        continue;
+                    }
+                }
+            }
+
+        public:
+            size_t reclaim() noexcept
+            {
+                // take blocks freed by other threads, owner thread only
+                size_t count = 0;
+                for(auto node = m_remote.exchange(nullptr, std::memory_order_acquire); node;){
+                    const auto next = node->next;
+                    local_free(reinterpret_cast<char *>(node), node->byte_count);
+
+                    node = next;
+                    count++;
+                }
+                return count;
+            }
+
+        public:
+            void reset() override
+            {
+                // all blocks must have been freed or abandoned
+                this->destroy_objects();
+                release_free_lists();
+                scoped_alloc::arena_interf<Alignment>::reset();
+            }
+
+        private:
+            static size_t class_index(size_t byte_count)
+            {
+                size_t index = 0;
+                for(size_t size = min_block_size(); size < byte_count; size *= 2){
+                    index++;
+                }
+                return index;
+            }
+
+            static size_t class_size(size_t index)
+            {
+                return min_block_size() << index;
+            }
+
+        private:
+            void local_free(char *p, size_t byte_count) noexcept
+            {
+                if(byte_count > MaxBlockSize){
+                    scoped_alloc::arena_interf<Alignment>::deallocate(p, byte_count);
+                    return;
+                }
+
+                const auto index = class_index(byte_count);
+                m_free[index] = new (p) free_node{m_free[index], class_size(index)};
+            }
+
+            void release_free_lists() noexcept
+            {
+                // blocks of free lists may come from dynamic_alloc(), return them
+                reclaim();
+                for(size_t index = 0; index < class_count(); ++index){
+                    while(const auto node = m_free[index]){
+                        m_free[index] = node->next;
+                        if(!this->owns(reinterpret_cast<char *>(node))){
+                            this->dynamic_free(reinterpret_cast<char *>(node), class_size(index));
+                        }
+                    }
+                }
+            }
+    };
+
+    template<size_t ObjectSize, size_t Alignment = alignof(std::max_align_t), size_t MagazineSize = 32> class slab_pool
+    {
+        // pool of fixed size objects carved from slabs, objects go back to OS only when pool is destroyed
+        // threads allocate and free through their own cache, with Bonwick style magazines
+        //
+        //     cache holds two magazines, stacks of free objects, fast path pops or pushes one of them, no lock or atomic
+        //     when both are exhausted, one magazine is exchanged with the depot under pool lock
+        //     so cross-thread traffic is one lock per MagazineSize objects
+        //
+        //     scoped_alloc::slab_pool<sizeof(msg)> pool;
+        //     ...
+        //     // in each thread
+        //     scoped_alloc::slab_pool<sizeof(msg)>::cache cache(pool);
+        //     auto p = cache.allocate();
+        //     ...
+        //     cache.deallocate(p);     // any thread's cache, objects move between threads freely
+        //
+        // caches must be destroyed before the pool, their magazines are returned to depot
+
+        private:
+            static_assert(ObjectSize > 0, "bad object size");
+            static_assert(MagazineSize > 0, "bad magazine size");
+
+        public:
+            constexpr static size_t object_size()
+            {
+                return scoped_alloc::aligned_size<Alignment>(ObjectSize);
+            }
+
+        private:
+            struct magazine
+            {
+                size_t count;
+                void *rounds[MagazineSize];
+            };
+
+        private:
+            const size_t m_slab_size;
+
+        private:
+            std::mutex m_lock;
+
+        private:
+            std::vector<char *> m_slabs;
+            char *m_slab_cursor = nullptr;
+            char *m_slab_end    = nullptr;
+
+        private:
+            std::vector<magazine *> m_full;
+            std::vector<magazine *> m_empty;
+
+        public:
+            slab_pool(size_t slab_size = 64 * 1024)
+                : m_slab_size(scoped_alloc::aligned_size<Alignment>(std::max<size_t>(slab_size, object_size())))
+            {}
+
+        public:
+            ~slab_pool()
+            {
+                for(auto mag: m_full){
+                    delete mag;
+                }
+
+                for(auto mag: m_empty){
+                    delete mag;
+                }
+
+                for(auto slab: m_slabs){
+                    scoped_alloc::free_aligned(slab);
+                }
+            }
+
+        public:
+            slab_pool(slab_pool &&) = delete;
+            slab_pool(const slab_pool &) = delete;
+            slab_pool &operator = (slab_pool &&) = delete;
+            slab_pool &operator = (const slab_pool &) = delete;
+
+        public:
+            size_t slabs()
+            {
+                const std::lock_guard<std::mutex> lock(m_lock);
+                return m_slabs.size();
+            }
+
+        private:
+            magazine *exchange_full(magazine *empty_mag)
+            {
+                // give a full magazine, then take back the empty one
+                // nothing is taken if it throws, caller still owns empty_mag
+                const std::lock_guard<std::mutex> lock(m_lock);
+                magazine *mag = nullptr;
+
+                if(!m_full.empty()){
+                    mag = m_full.back();
+                    m_full.pop_back();
+                }
+
+                else{
+                    // depot has no full magazine, fill one from slab
+                    mag = pop_empty();
+                    try{
+                        while(mag->count < MagazineSize){
+                            if(m_slab_cursor == m_slab_end){
+                                m_slabs.reserve(m_slabs.size() + 1);
+                                const auto slab = scoped_alloc::alloc_aligned<Alignment>(m_slab_size);
+                                m_slabs.push_back(slab.buf);
+
+                                m_slab_cursor = slab.buf;
+                                m_slab_end    = slab.buf + m_slab_size / object_size() * object_size();
+                            }
+
+                            mag->rounds[mag->count++] = m_slab_cursor;
+                            m_slab_cursor += object_size();
+                        }
+                    }
+                    catch(...){
+                        // keep the partly filled magazine and its rounds in depot
+                        stash(mag);
+                        throw;
+                    }
+                }
+
+                stash(empty_mag);
+                return mag;
+            }
+
+            magazine *exchange_empty(magazine *full_mag)
+            {
+                // give an empty magazine, then take back the full one
+                const std::lock_guard<std::mutex> lock(m_lock);
+                const auto mag = pop_empty();
+
+                stash(full_mag);
+                return mag;
+            }
+
+            void return_magazine(magazine *mag) noexcept
+            {
+                const std::lock_guard<std::mutex> lock(m_lock);
+                stash(mag);
+            }
+
+            void stash(magazine *mag) noexcept
+            {
+                // put magazine in depot, caller holds the lock
+                // if depot can't grow, the magazine is dropped, its rounds stay in slabs till pool is destroyed
+
+                if(!mag){
+                    return;
+                }
+
+                try{
+                    if(mag->count){
+                        m_full.push_back(mag);
+                    }
+
+                    else{
+                        m_empty.push_back(mag);
+                    }
+                }
+                catch(...){
+                    delete mag;
+                }
+            }
+
+            magazine *pop_empty()
+            {
+                if(!m_empty.empty()){
+                    const auto mag = m_empty.back();
+                    m_empty.pop_back();
+                    return mag;
+                }
+                return new magazine{0, {}};
+            }
+
+        public:
+            class cache
+            {
+                private:
+                    slab_pool &m_pool;
+
+                private:
+                    magazine *m_loaded   = nullptr;
+                    magazine *m_previous = nullptr;
+
+                public:
+                    explicit cache(slab_pool &pool)
+                        : m_pool(pool)
+                    {}
+
+                public:
+                    ~cache()
+                    {
+                        m_pool.return_magazine(m_loaded);
+                        m_pool.return_magazine(m_previous);
+                    }
+
+                public:
+                    cache(cache &&) = delete;
+                    cache(const cache &) = delete;
+                    cache &operator = (cache &&) = delete;
+                    cache &operator = (const cache &) = delete;
+
+                public:
+                    void *allocate()
+                    {
+                        if(m_loaded && m_loaded->count){
+                            return m_loaded->rounds[--m_loaded->count];
+                        }
+
+                        if(m_previous && m_previous->count){
+                            std::swap(m_loaded, m_previous);
+                            return m_loaded->rounds[--m_loaded->count];
+                        }
+
+                        // both empty, return one to depot for a full one
+                        // rotate only after exchange succeeds, cache is unchanged if it throws
+                        const auto full_mag = m_pool.exchange_full(m_previous);
+                        m_previous = m_loaded;
+                        m_loaded = full_mag;
+                        return m_loaded->rounds[--m_loaded->count];
+                    }
+
+                    void deallocate(void *p)
+                    {
+                        if(!p){
+                            return;
+                        }
+
+                        if(m_loaded && m_loaded->count < MagazineSize){
+                            m_loaded->rounds[m_loaded->count++] = p;
+                            return;
+                        }
+
+                        if(m_previous && m_previous->count < MagazineSize){
+                            std::swap(m_loaded, m_previous);
+                            m_loaded->rounds[m_loaded->count++] = p;
+                            return;
+                        }
+
+                        // both full, return one to depot for an empty one
+                        const auto empty_mag = m_pool.exchange_empty(m_previous);
+                        m_previous = m_loaded;
+                        m_loaded = empty_mag;
+                        m_loaded->rounds[m_loaded->count++] = p;
+                    }
+
+                public:
+                    template<typename T, typename... Args> T *make(Args && ... args)
+                    {
+                        static_assert(sizeof(T) <= ObjectSize && alignof(T) <= Alignment, "object doesn't fit slab_pool");
+
+                        const auto p = allocate();
+                        try{
+                            return new (p) T(std::forward<Args>(args)...);
+                        }
+                        catch(...){
+                            deallocate(p);
+                            throw;
+                        }
+                    }
+
+                    template<typename T> void destroy(T *p)
+                    {
+                        if(p){
+                            p->~T();
+                            deallocate(p);
+                        }
+                    }
+            };
+    };
+
+    template<class Arena> class double_ended_arena: public Arena
+    {
+        // arena allocates from both ends of its buffer
+        // bottom takes persistent results by allocate(), same as Arena
+        // top takes temporary scratch by allocate_top(), rewinds by marker independently
+        // results then stay compact even scratch allocations are interleaved
+        //
+        //     scoped_alloc::double_ended_arena<scoped_alloc::dynamic_arena<>> a(4096);
+        //     {
+        //         const auto scratch = a.top_scope();
+        //         std::vector<int, scoped_alloc::allocator<int>> result(a);
+        //
+        //         auto tmp = a.template allocate_top<alignof(int)>(1024);
+        //         ...
+        //     }
+        //
+        // scratch falls back to heap if both ends meet, heap blocks need explicit deallocate()
+        // rewind doesn't release them
+
+        public:
+            using arena_type = scoped_alloc::arena_interf<Arena::alignment>;
+
+        public:
+            using Arena::Arena;
+
+        public:
+            template<size_t RequestAlignment> char *allocate_top(size_t byte_count)
+            {
+                return arena_type::template allocate_top<RequestAlignment>(byte_count);
+            }
+
+        public:
+            size_t top_used() const
+            {
+                return arena_type::top_used();
+            }
+
+            size_t top_marker() const
+            {
+                return top_used();
+            }
+
+            void rewind_top(size_t marker)
+            {
+                this->set_top_used(marker);
+            }
+
+        public:
+            class top_scope_guard
+            {
+                private:
+                    double_ended_arena *m_arena;
+                    size_t m_marker;
+
+                public:
+                    explicit top_scope_guard(double_ended_arena &arena)
+                        : m_arena(&arena)
+                        , m_marker(arena.top_marker())
+                    {}
+
+                public:
+                    top_scope_guard(top_scope_guard &&other) noexcept
+                        : m_arena(other.m_arena)
+                        , m_marker(other.m_marker)
+                    {
+                        other.m_arena = nullptr;
+                    }
+
+                public:
+                    ~top_scope_guard()
+                    {
+                        if(m_arena){
+                            m_arena->rewind_top(m_marker);
+                        }
+                    }
+
+                public:
+                    top_scope_guard(const top_scope_guard &) = delete;
+                    top_scope_guard &operator = (top_scope_guard &&) = delete;
+                    top_scope_guard &operator = (const top_scope_guard &) = delete;
+            };
+
+            top_scope_guard top_scope()
+            {
+                // rewind top allocation at end of scope
+                return top_scope_guard(*this);
+            }
+
+#ifdef SCOPED_ALLOC_SUPPORT_MMAP
+        public:
+            void append_used_iovec(scoped_alloc::iovec_list &list) const override
+            {
+                Arena::append_used_iovec(list);
+                if(this->has_buf() && top_used()){
+                    list.add(this->top_begin(), top_used());
+                }
+            }
+#endif
+    };
+
+    template<typename T, typename OffsetType = std::ptrdiff_t> class offset_ptr
+    {
+        // self-relative pointer, stores distance from itself to the pointee
+        // stays valid if the region holding both the pointer and the pointee is mapped at another address
+        //
+        // offset 1 is reserved for nullptr
+        // pointee can't start inside the offset_ptr itself
+
+        private:
+            static_assert(std::is_integral<OffsetType>::value && std::is_signed<OffsetType>::value, "bad offset type");
+            static_assert(sizeof(OffsetType) <= sizeof(std::ptrdiff_t), "bad offset type");
+
+        public:
+            template<typename U, typename O> friend class scoped_alloc::offset_ptr;
+
+        public:
+            using element_type      = T;
+            using value_type        = std::remove_cv_t<T>;
+            using difference_type   = std::ptrdiff_t;
+            using pointer           = T *;
+            using reference         = std::add_lvalue_reference_t<T>;
+            using offset_type       = OffsetType;
+            using iterator_category = std::random_access_iterator_tag;
+
+        public:
+            template<typename U> using rebind = offset_ptr<U, OffsetType>;
+
+        private:
+            OffsetType m_off = 1;
+
+        private:
+            void set_ptr(const volatile void *p)
+            {
+                if(!p){
+                    m_off = 1;
+                    return;
+                }
+
+                const auto off = reinterpret_cast<const volatile char *>(p) - reinterpret_cast<const volatile char *>(this);
+                if(sizeof(OffsetType) < sizeof(std::ptrdiff_t)){
+                    if(off < std::numeric_limits<OffsetType>::min() || off > std::numeric_limits<OffsetType>::max()){
+                        throw fflerror("offset out of range: %td", off);
+                    }
+                }
+                m_off = static_cast<OffsetType>(off);
+            }
+
+        public:
+            offset_ptr() = default;
+            offset_ptr(std::nullptr_t) noexcept {}
+
+        public:
+            offset_ptr(T *p)
+            {
+                set_ptr(p);
+            }
+
+            offset_ptr(const offset_ptr &p)
+            {
+                set_ptr(p.get());
+            }
+
+            template<typename U, std::enable_if_t<std::is_convertible<U *, T *>::value, int> = 0> offset_ptr(const offset_ptr<U, OffsetType> &p)
+            {
+                set_ptr(static_cast<T *>(p.get()));
+            }
+
+            template<typename U, std::enable_if_t<!std::is_convertible<U *, T *>::value, int> = 0, typename = decltype(static_cast<T *>(std::declval<U *>()))> explicit offset_ptr(const offset_ptr<U, OffsetType> &p)
+            {
+                set_ptr(static_cast<T *>(p.get()));
+            }
+
+        public:
+            offset_ptr &operator = (const offset_ptr &p)
+            {
+                set_ptr(p.get());
+                return *this;
+            }
+
+            offset_ptr &operator = (T *p)
+            {
+                set_ptr(p);
+                return *this;
+            }
+
+            offset_ptr &operator = (std::nullptr_t) noexcept
+            {
+                m_off = 1;
+                return *this;
+            }
+
+        public:
+            T *get() const noexcept
+            {
+                if(m_off == 1){
+                    return nullptr;
+                }
+                return static_cast<T *>(const_cast<void *>(static_cast<const volatile void *>(reinterpret_cast<const volatile char *>(this) + m_off)));
+            }
+
+        public:
+            T *operator -> () const noexcept
+            {
+                return get();
+            }
+
+            template<typename U = T> std::enable_if_t<!std::is_void<U>::value, U &> operator * () const noexcept
+            {
+                return *get();
+            }
+
+            template<typename U = T> std::enable_if_t<!std::is_void<U>::value, U &> operator [] (std::ptrdiff_t n) const noexcept
+            {
+                return get()[n];
+            }
+
+            explicit operator bool () const noexcept
+            {
+                return m_off != 1;
+            }
+
+        public:
+            template<typename U = T> static std::enable_if_t<!std::is_void<U>::value, offset_ptr> pointer_to(U &r)
+            {
+                return offset_ptr(std::addressof(r));
+            }
+
+        public:
+            offset_ptr &operator += (std::ptrdiff_t n)
+            {
+                set_ptr(get() + n);
+                return *this;
+            }
+
+            offset_ptr &operator -= (std::ptrdiff_t n)
+            {
+                set_ptr(get() - n);
+                return *this;
+            }
+
+            offset_ptr &operator ++ ()
+            {
+                return *this += 1;
+            }
+
+            offset_ptr &operator -- ()
+            {
+                return *this -= 1;
+            }
+
+            offset_ptr operator ++ (int)
+            {
+                offset_ptr p(*this);
+                *this += 1;
+                return p;
+            }
+
+            offset_ptr operator -- (int)
+            {
+                offset_ptr p(*this);
+                *this -= 1;
+                return p;
+            }
+
+        public:
+            friend offset_ptr operator + (offset_ptr p, std::ptrdiff_t n)
+            {
+                return p += n;
+            }
+
+            friend offset_ptr operator + (std::ptrdiff_t n, offset_ptr p)
+            {
+                return p += n;
+            }
+
+            friend offset_ptr operator - (offset_ptr p, std::ptrdiff_t n)
+            {
+                return p -= n;
+            }
+
+            friend std::ptrdiff_t operator - (const offset_ptr &p1, const offset_ptr &p2) noexcept
+            {
+                return p1.get() - p2.get();
+            }
+    };
+
+    template<typename T1, typename T2, typename O> bool operator == (const offset_ptr<T1, O> &p1, const offset_ptr<T2, O> &p2) noexcept
+    {
+        return p1.get() == p2.get();
+    }
+
+    template<typename T1, typename T2, typename O> bool operator != (const offset_ptr<T1, O> &p1, const offset_ptr<T2, O> &p2) noexcept
+    {
+        return p1.get() != p2.get();
+    }
+
+    template<typename T1, typename T2, typename O> bool operator <  (const offset_ptr<T1, O> &p1, const offset_ptr<T2, O> &p2) noexcept
+    {
+        return p1.get() <  p2.get();
+    }
+
+    template<typename T1, typename T2, typename O> bool operator <= (const offset_ptr<T1, O> &p1, const offset_ptr<T2, O> &p2) noexcept
+    {
+        return p1.get() <= p2.get();
+    }
+
+    template<typename T1, typename T2, typename O> bool operator >  (const offset_ptr<T1, O> &p1, const offset_ptr<T2, O> &p2) noexcept
+    {
+        return p1.get() >  p2.get();
+    }
+
+    template<typename T1, typename T2, typename O> bool operator >= (const offset_ptr<T1, O> &p1, const offset_ptr<T2, O> &p2) noexcept
+    {
+        return p1.get() >= p2.get();
+    }
+
+    template<typename T, typename O> bool operator == (const offset_ptr<T, O> &p, std::nullptr_t) noexcept
+    {
+        return !p;
+    }
+
+    template<typename T, typename O> bool operator == (std::nullptr_t, const offset_ptr<T, O> &p) noexcept
+    {
+        return !p;
+    }
+
+    template<typename T, typename O> bool operator != (const offset_ptr<T, O> &p, std::nullptr_t) noexcept
+    {
+        return bool(p);
+    }
+
+    template<typename T, typename O> bool operator != (std::nullptr_t, const offset_ptr<T, O> &p) noexcept
+    {
+        return bool(p);
+    }
+
+    template<typename T, typename OffsetType = std::ptrdiff_t> class offset_array
+    {
+        // fixed size array with relocatable storage
+        // elements are allocated from an arena and never destroyed
+        // if both the offset_array and its elements live in the same arena, the arena can be mapped at any address
+
+        private:
+            static_assert(std::is_trivially_destructible<T>::value, "offset_array never destroys its elements");
+
+        private:
+            scoped_alloc::offset_ptr<T, OffsetType> m_data;
+            size_t m_size = 0;
+
+        public:
+            template<size_t Alignment> void alloc(scoped_alloc::arena_interf<Alignment> &arena, size_t n)
+            {
+                if(m_data){
+                    throw fflerror("offset_array has buffer attached");
+                }
+
+                if(n == 0){
+                    return;
+                }
+
+                auto p = reinterpret_cast<T *>(arena.template allocate<alignof(T)>(n * sizeof(T)));
+                for(size_t i = 0; i < n; ++i){
+                    new (p + i) T();
+                }
+
+                m_data = p;
+                m_size = n;
+            }
+
+        public:
+            size_t size() const
+            {
+                return m_size;
+            }
+
+            bool empty() const
+            {
+                return m_size == 0;
+            }
+
+        public:
+            T *data() const
+            {
+                return m_data.get();
+            }
+
+            T *begin() const
+            {
+                return data();
+            }
+
+            T *end() const
+            {
+                return data() + m_size;
+            }
+
+            T &operator [] (size_t i) const
+            {
+                return data()[i];
+            }
+    };
+
+#ifdef SCOPED_ALLOC_SUPPORT_MMAP
+    template<size_t Alignment = alignof(std::max_align_t)> class file_arena: public scoped_alloc::arena_interf<Alignment>
+    {
+        // map a file as arena buffer with MAP_SHARED
+        // buffer content and cursor persist in the file, a restarted process maps the file and uses data directly
+        //
+        // file can be mapped at a different address after restart
+        // so data in file_arena should only use relocatable pointers, i.e. offset_ptr, offset_array
+        // the root object is the entry to all data, see make_root() and root()
+
+        private:
+            static_assert(Alignment <= 4096, "file_arena alignment exceeds page size");
+
+        private:
+            struct file_header
+            {
+                uint64_t magic;
+                uint64_t alignment;
+                uint64_t size;
+                uint64_t used;
+                uint64_t root;
+            };
+
+        private:
+            int    m_fd   = -1;
+            char  *m_map  = nullptr;
+            size_t m_mapsize = 0;
+
+        private:
+            bool m_warm = false;
+
+        private:
+            static uint64_t header_magic()
+            {
+                return 0x31414e4552414653; // "SFARENA1"
+            }
+
+            static uint64_t null_root()
+            {
+                return UINT64_MAX;
+            }
+
+            static size_t header_size()
+            {
+                return scoped_alloc::aligned_size<Alignment>(sizeof(file_header));
+            }
+
+            file_header *header() const
+            {
+                return reinterpret_cast<file_header *>(m_map);
+            }
+
+        public:
+            file_arena(const char *path, size_t byte_count = 0): scoped_alloc::arena_interf<Alignment>()
+            {
+                if(!path){
+                    throw fflerror("invalid argument: path = null");
+                }
+
+                if((m_fd = ::open(path, O_RDWR | O_CREAT, 0644)) < 0){
+                    throw fflerror("open(%s) failed: %s", path, std::strerror(errno));
+                }
+
+                try{
+                    attach(path, byte_count);
+                }
+                catch(...){
+                    detach();
+                    throw;
+                }
+            }
+
+        public:
+            ~file_arena() override
+            {
+                // objects created by make() are destroyed with the arena object, not the file
+                if(m_map && this->has_buf()){
+                    this->destroy_objects();
+                    header()->used = this->used();
+                }
+                detach();
+            }
+
+        private:
+            void attach(const char *path, size_t byte_count)
+            {
+                struct stat st;
+                if(::fstat(m_fd, &st)){
+                    throw fflerror("fstat(%s) failed: %s", path, std::strerror(errno));
+                }
+
+                file_header hdr {};
+                const auto file_size = static_cast<size_t>(st.st_size);
+
+                if(file_size > 0){
+                    if(file_size < header_size() || ::pread(m_fd, &hdr, sizeof(hdr), 0) != static_cast<ssize_t>(sizeof(hdr)) || hdr.magic != header_magic()){
+                        throw fflerror("%s is not a file_arena", path);
+                    }
+
+                    if(hdr.alignment != Alignment){
+                        throw fflerror("%s has alignment %zu, expect %zu", path, static_cast<size_t>(hdr.alignment), Alignment);
+                    }
+
+                    if(hdr.used > hdr.size || header_size() + hdr.size > file_size){
+                        throw fflerror("%s has corrupted header", path);
+                    }
+                    m_warm = true;
+                }
+
+                else if(byte_count == 0){
+                    throw fflerror("bad argument: byte_count = 0 to create %s", path);
+                }
+
+                // never shrink existing file
+                // grow it if caller asks for a bigger buffer, existing content is kept
+
+                const size_t buf_size = std::max<size_t>(hdr.size, scoped_alloc::aligned_size<Alignment>(byte_count));
+                m_mapsize = header_size() + buf_size;
+
+                if(m_mapsize > file_size && ::ftruncate(m_fd, static_cast<off_t>(m_mapsize))){
+                    throw fflerror("ftruncate(%s, %zu) failed: %s", path, m_mapsize, std::strerror(errno));
+                }
+
+                void *p = ::mmap(nullptr, m_mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+                if(p == MAP_FAILED){
+                    throw fflerror("mmap(%s, %zu) failed: %s", path, m_mapsize, std::strerror(errno));
+                }
+
+                m_map = static_cast<char *>(p);
+                if(!m_warm){
+                    header()->used = 0;
+                    header()->root = null_root();
+                }
+
+                header()->magic     = header_magic();
+                header()->alignment = Alignment;
+                header()->size      = buf_size;
+
+                this->set_buf(scoped_alloc::aligned_buf<Alignment>{m_map + header_size(), buf_size});
+                this->set_used(header()->used);
+            }
+
+            void detach()
+            {
+                if(m_map){
+                    ::munmap(m_map, m_mapsize);
+                }
+
+                if(m_fd >= 0){
+                    ::close(m_fd);
+                }
+
+                m_fd      = -1;
+                m_map     = nullptr;
+                m_mapsize = 0;
+            }
+
+        public:
+            bool warm() const
+            {
+                // true if buffer content comes from an existing file
+                return m_warm;
+            }
+
+        public:
+            void sync(bool async = false)
+            {
+                header()->used = this->used();
+                if(::msync(m_map, m_mapsize, async ? MS_ASYNC : MS_SYNC)){
+                    throw fflerror("msync(%p, %zu) failed: %s", static_cast<void *>(m_map), m_mapsize, std::strerror(errno));
+                }
+            }
+
+        public:
+            void set_root(const void *p)
+            {
+                if(!p){
+                    header()->root = null_root();
+                    return;
+                }
+
+                auto cp = static_cast<char *>(const_cast<void *>(p));
+                if(!(this->in_buf(cp) && cp < this->get_buf().buf + this->get_buf().size)){
+                    throw fflerror("root object %p is not in file_arena", p);
+                }
+                header()->root = static_cast<uint64_t>(cp - this->get_buf().buf);
+            }
+
+            template<typename T> T *root() const
+            {
+                if(header()->root == null_root()){
+                    return nullptr;
+                }
+                return reinterpret_cast<T *>(this->get_buf().buf + header()->root);
+            }
+
+            template<typename T, typename... Args> T *make_root(Args && ... args)
+            {
+                // root object is never destroyed, it lives as long as the file
+                auto p = new (this->template allocate<alignof(T)>(sizeof(T))) T(std::forward<Args>(args)...);
+                set_root(p);
+                return p;
+            }
+
+        public:
+            char *dynamic_alloc(size_t byte_count) override
+            {
+                // heap memory doesn't persist in the file
+                throw fflerror("file_arena is full: used = %zu, size = %zu, byte_count = %zu", this->used(), this->get_buf().size, byte_count);
+            }
+    };
+
+    template<size_t Alignment = alignof(std::max_align_t)> class shm_arena: public scoped_alloc::arena_interf<Alignment>
+    {
+        // arena in shared memory, mapped by multiple processes
+        // created by shm_open() with a name, or by memfd_create() without a name and shared by fd
+        //
+        // a process-shared atomic cursor in the region is the only synchronization
+        // each process claims a window from the region and bump-allocates inside it, arena_interf works on the window
+        // windows are claimed lazily, processes only reading the region never claim
+        //
+        // region is mapped at different addresses in different processes
+        // data shared across processes should only use relocatable pointers, see offset_allocator
+        //
+        // NOTICE: after fork() the child shares the window of the parent
+        //         child must call drop_window() before allocating
+
+        private:
+            static_assert(Alignment <= 4096, "shm_arena alignment exceeds page size");
+            // check the type in use, uint64_t can be either unsigned long or unsigned long long
+#if __cplusplus >= 201703L
+            static_assert(std::atomic<uint64_t>::is_always_lock_free, "shm_arena requires address-free 64-bit atomics");
+#else
+            static_assert((sizeof(uint64_t) == sizeof(long) ? ATOMIC_LONG_LOCK_FREE : ATOMIC_LLONG_LOCK_FREE) == 2, "shm_arena requires address-free 64-bit atomics");
+#endif
+
+        private:
+            struct shm_header
+            {
+                std::atomic<uint64_t> magic;
+                uint64_t alignment;
+                uint64_t size;
+                std::atomic<uint64_t> cursor;
+                std::atomic<uint64_t> root;
+            };
+
+        private:
+            int    m_fd   = -1;
+            char  *m_map  = nullptr;
+            size_t m_mapsize = 0;
+
+        private:
+            const size_t m_window;
+
+        private:
+            static uint64_t header_magic()
+            {
+                return 0x31414e4552414d53; // "SMARENA1"
+            }
+
+            static uint64_t null_root()
+            {
+                return UINT64_MAX;
+            }
+
+            static size_t header_size()
+            {
+                return scoped_alloc::aligned_size<Alignment>(sizeof(shm_header));
+            }
+
+            shm_header *header() const
+            {
+                return reinterpret_cast<shm_header *>(m_map);
+            }
+
+            char *region() const
+            {
+                return m_map + header_size();
+            }
+
+        public:
+            shm_arena(const char *name, size_t byte_count = 0, size_t window = 64 * 1024)
+                : scoped_alloc::arena_interf<Alignment>()
+                , m_window(scoped_alloc::aligned_size<Alignment>(window))
+            {
+                // name = nullptr: create anonymous region by memfd_create(), share it by fd()
+                // byte_count = 0: attach to existing region only
+
+                bool create = false;
+                if(name){
+                    if(byte_count && (m_fd = ::shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) >= 0){
+                        create = true;
+                    }
+                    else if((m_fd = ::shm_open(name, O_RDWR, 0600)) < 0){
+                        throw fflerror("shm_open(%s) failed: %s", name, std::strerror(errno));
+                    }
+                }
+
+                else{
+#ifdef __linux__
+                    if(byte_count == 0){
+                        throw fflerror("bad argument: byte_count = 0 to create anonymous shm_arena");
+                    }
+
+                    if((m_fd = ::memfd_create("shm_arena", MFD_CLOEXEC)) < 0){
+                        throw fflerror("memfd_create() failed: %s", std::strerror(errno));
+                    }
+                    create = true;
+#else
+                    throw fflerror("anonymous shm_arena requires memfd_create()");
+#endif
+                }
+
+                try{
+                    attach(create, byte_count);
+                }
+                catch(...){
+                    detach();
+                    throw;
+                }
+            }
+
+            shm_arena(int fd, size_t window)
+                : scoped_alloc::arena_interf<Alignment>()
+                , m_window(scoped_alloc::aligned_size<Alignment>(window))
+            {
+                // attach to region by fd received from other process
+                // shm_arena takes ownership of the fd
+
+                m_fd = fd;
+                try{
+                    attach(false, 0);
+                }
+                catch(...){
+                    detach();
+                    throw;
+                }
+            }
+
+        public:
+            ~shm_arena() override
+            {
+                // objects created by make() belong to this process
+                // they are destroyed when this process detaches
+                if(m_map){
+                    this->destroy_objects();
+                }
+                detach();
+            }
+
+        private:
+            void attach(bool create, size_t byte_count)
+            {
+                if(m_window == 0){
+                    throw fflerror("bad argument: window = 0");
+                }
+
+                if(create){
+                    m_mapsize = header_size() + scoped_alloc::aligned_size<Alignment>(byte_count);
+                    if(::ftruncate(m_fd, static_cast<off_t>(m_mapsize))){
+                        throw fflerror("ftruncate(%d, %zu) failed: %s", m_fd, m_mapsize, std::strerror(errno));
+                    }
+                }
+
+                else{
+                    struct stat st;
+                    if(::fstat(m_fd, &st)){
+                        throw fflerror("fstat(%d) failed: %s", m_fd, std::strerror(errno));
+                    }
+
+                    if(static_cast<size_t>(st.st_size) <= header_size()){
+                        throw fflerror("shm region is not initialized");
+                    }
+                    m_mapsize = static_cast<size_t>(st.st_size);
+                }
+
+                void *p = ::mmap(nullptr, m_mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+                if(p == MAP_FAILED){
+                    throw fflerror("mmap(%d, %zu) failed: %s", m_fd, m_mapsize, std::strerror(errno));
+                }
+                m_map = static_cast<char *>(p);
+
+                if(create){
+                    new (m_map) shm_header();
+
+                    header()->alignment = Alignment;
+                    header()->size      = m_mapsize - header_size();
+                    header()->cursor.store(0, std::memory_order_relaxed);
+                    header()->root  .store(null_root(), std::memory_order_relaxed);
+                    header()->magic .store(header_magic(), std::memory_order_release);
+                }
+
+                else{
+                    if(header()->magic.load(std::memory_order_acquire) != header_magic()){
+                        throw fflerror("shm region is not a shm_arena");
+                    }
+
+                    if(header()->alignment != Alignment || header_size() + header()->size > m_mapsize){
+                        throw fflerror("shm region has incompatible header: alignment = %zu, size = %zu", static_cast<size_t>(header()->alignment), static_cast<size_t>(header()->size));
+                    }
+                }
+                drop_window();
+            }
+
+            void detach()
+            {
+                if(m_map){
+                    ::munmap(m_map, m_mapsize);
+                }
+
+                if(m_fd >= 0){
+                    ::close(m_fd);
+                }
+
+                m_fd      = -1;
+                m_map     = nullptr;
+                m_mapsize = 0;
+            }
+
+        private:
+            char *claim(size_t byte_count)
+            {
+                auto off = header()->cursor.load(std::memory_order_relaxed);
+                do{
+                    if(byte_count > header()->size - off){
+                        return nullptr;
+                    }
+                }while(!header()->cursor.compare_exchange_weak(off, off + byte_count, std::memory_order_relaxed));
+                return region() + off;
+            }
+
+        public:
+            void drop_window()
+            {
+                // use the header block as an exhausted window
+                // next allocation claims a new window from the shared cursor
+
+                this->set_buf(scoped_alloc::aligned_buf<Alignment>{m_map, header_size()});
+                this->set_used(header_size());
+            }
+
+            void reset() override
+            {
+                if(this->get_buf().buf != m_map){
+                    scoped_alloc::arena_interf<Alignment>::reset();
+                }
+            }
+
+            void append_used_iovec(scoped_alloc::iovec_list &list) const override
+            {
+                // shared prefix claimed by all processes
+                if(const auto byte_count = shared_used()){
+                    list.add(region(), byte_count);
+                }
+            }
+
+        public:
+            int fd() const
+            {
+                return m_fd;
+            }
+
+            size_t shared_used() const
+            {
+                return header()->cursor.load(std::memory_order_relaxed);
+            }
+
+            size_t shared_size() const
+            {
+                return header()->size;
+            }
+
+            static void remove(const char *name)
+            {
+                if(::shm_unlink(name)){
+                    throw fflerror("shm_unlink(%s) failed: %s", name, std::strerror(errno));
+                }
+            }
+
+        public:
+            void set_root(const void *p)
+            {
+                if(!p){
+                    header()->root.store(null_root(), std::memory_order_release);
+                    return;
+                }
+
+                auto cp = static_cast<const char *>(p);
+                if(!(region() <= cp && cp < region() + header()->size)){
+                    throw fflerror("root object %p is not in shm_arena", p);
+                }
+                header()->root.store(static_cast<uint64_t>(cp - region()), std::memory_order_release);
+            }
+
+            template<typename T> T *root() const
+            {
+                const auto off = header()->root.load(std::memory_order_acquire);
+                if(off == null_root()){
+                    return nullptr;
+                }
+                return reinterpret_cast<T *>(region() + off);
+            }
+
+        public:
+            char *dynamic_alloc(size_t byte_count) override
+            {
+                // never fall back to heap, other processes can't see it
+                // large allocation bypasses the window, or region is almost full to claim a window
+
+                const auto byte_count_aligned = scoped_alloc::aligned_size<Alignment>(byte_count);
+                if(byte_count_aligned * 2 <= m_window){
+                    if(auto p = claim(m_window)){
+                        this->set_buf(scoped_alloc::aligned_buf<Alignment>{p, m_window});
+                        return this->template allocate<Alignment>(byte_count);
+                    }
+                }
+
+                if(auto p = claim(byte_count_aligned)){
+                    return p;
+                }
+                throw fflerror("shm_arena is full: shared_used = %zu, size = %zu, byte_count = %zu", shared_used(), shared_size(), byte_count);
+            }
+
+            void dynamic_free(char *, size_t) noexcept override
+            {
+                // memory out of current window can't be recycled
+            }
+    };
+
+    template<size_t PageSize = 4096> class io_arena: public scoped_alloc::dynamic_arena<PageSize>
+    {
+        // arena for direct I/O, i.e. O_DIRECT, io_uring
+        // every allocation is page aligned and page-multiple sized, fallback allocation as well
+        //
+        // the backing region can be registered as io_uring fixed buffer with index 0
+        // any allocation inside region() can be used by IORING_OP_READ_FIXED/WRITE_FIXED
+
+        private:
+            static_assert(PageSize >= 512, "io_arena needs at least sector alignment");
+
+        private:
+            int m_ring_fd = -1;
+
+        public:
+            explicit io_arena(size_t byte_count = 0): scoped_alloc::dynamic_arena<PageSize>(byte_count)
+            {}
+
+        public:
+            ~io_arena() override
+            {
+                if(m_ring_fd >= 0){
+                    unregister_buffers();
+                }
+            }
+
+        public:
+            struct iovec region() const
+            {
+                const auto buf = this->get_buf_ex();
+                return {buf.buf, buf.size};
+            }
+
+        public:
+            char *allocate_block(size_t byte_count)
+            {
+                return this->template allocate<PageSize>(byte_count);
+            }
+
+            scoped_alloc::iovec_list allocate_iovec(size_t block_size, size_t count)
+            {
+                // allocate count blocks as one scatter-gather list
+                // each block is rounded up to page size
+
+                scoped_alloc::iovec_list list;
+                const auto block_size_aligned = scoped_alloc::aligned_size<PageSize>(block_size);
+
+                for(size_t i = 0; i < count; ++i){
+                    list.add(allocate_block(block_size_aligned), block_size_aligned);
+                }
+                return list;
+            }
+
+#if defined(__linux__) && defined(SYS_io_uring_register)
+        public:
+            void register_buffers(int ring_fd)
+            {
+                // same as io_uring_register_buffers(ring, &region(), 1) in liburing
+
+                if(m_ring_fd >= 0){
+                    throw fflerror("io_arena has been registered to ring fd %d", m_ring_fd);
+                }
+
+                auto iov = region();
+                if(::syscall(SYS_io_uring_register, ring_fd, 0 /* IORING_REGISTER_BUFFERS */, &iov, 1)){
+                    throw fflerror("io_uring_register(%d, IORING_REGISTER_BUFFERS) failed: %s", ring_fd, std::strerror(errno));
+                }
+                m_ring_fd = ring_fd;
+            }
+
+            void unregister_buffers()
+            {
+                if(m_ring_fd >= 0){
+                    ::syscall(SYS_io_uring_register, m_ring_fd, 1 /* IORING_UNREGISTER_BUFFERS */, nullptr, 0);
+                    m_ring_fd = -1;
+                }
+            }
+#else
+        public:
+            void unregister_buffers()
+            {
+            }
+#endif
+    };
+
+    class ring_arena
+    {
+        // ring buffer backed by a memfd mapped twice back to back
+        // any record crossing the end of the ring is still contiguous in virtual memory
+        //
+        // allocate() advances the head, release() advances the tail, records are released in FIFO order
+        // allocation is byte granular, no alignment padding between records
+        // no synchronization, caller takes care of it if producer and consumer are different threads
+
+        private:
+            int    m_fd   = -1;
+            char  *m_map  = nullptr;
+            size_t m_size = 0;
+
+        private:
+            size_t m_tail = 0;
+            size_t m_used = 0;
+
+        public:
+            ring_arena(ring_arena &&) = delete;
+            ring_arena(const ring_arena &) = delete;
+            ring_arena &operator = (ring_arena &&) = delete;
+            ring_arena &operator = (const ring_arena &) = delete;
+
+        public:
+            explicit ring_arena(size_t byte_count)
+            {
+                // ring size is rounded up to page size
+                // mapping twice needs page granularity
+
+                const auto page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+                if(byte_count == 0){
+                    throw fflerror("bad argument: byte_count = 0");
+                }
+
+                m_size = (byte_count + page_size - 1) / page_size * page_size;
+                try{
+                    attach();
+                }
+                catch(...){
+                    detach();
+                    throw;
+                }
+            }
+
+            ~ring_arena()
+            {
+                detach();
+            }
+
+        private:
+            void attach()
+            {
+#ifdef __linux__
+                if((m_fd = ::memfd_create("ring_arena", MFD_CLOEXEC)) < 0){
+                    throw fflerror("memfd_create() failed: %s", std::strerror(errno));
+                }
+#else
+                throw fflerror("ring_arena requires memfd_create()");
+#endif
+                if(::ftruncate(m_fd, static_cast<off_t>(m_size))){
+                    throw fflerror("ftruncate(%d, %zu) failed: %s", m_fd, m_size, std::strerror(errno));
+                }
+
+                // reserve address space for two copies first
+                // then map the memfd to each half with MAP_FIXED
+
+                void *p = ::mmap(nullptr, m_size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if(p == MAP_FAILED){
+                    throw fflerror("mmap(%zu) failed: %s", m_size * 2, std::strerror(errno));
+                }
+                m_map = static_cast<char *>(p);
+
+                for(auto half: {m_map, m_map + m_size}){
+                    if(::mmap(half, m_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, m_fd, 0) == MAP_FAILED){
+                        throw fflerror("mmap(%p, %zu, MAP_FIXED) failed: %s", static_cast<void *>(half), m_size, std::strerror(errno));
+                    }
+                }
+            }
+
+            void detach()
+            {
+                if(m_map){
+                    ::munmap(m_map, m_size * 2);
+                }
+
+                if(m_fd >= 0){
+                    ::close(m_fd);
+                }
+
+                m_fd   = -1;
+                m_map  = nullptr;
+                m_tail = 0;
+                m_used = 0;
+            }
+
+        public:
+            size_t size() const
+            {
+                return m_size;
+            }
+
+            size_t used() const
+            {
+                return m_used;
+            }
+
+            size_t available() const
+            {
+                return m_size - m_used;
+            }
+
+        public:
+            char *readable() const
+            {
+                // all unreleased records, contiguous for used() bytes
+                return m_map + m_tail;
+            }
+
+            char *writable() const
+            {
+                // free space after the head, contiguous for available() bytes
+                // write into it then call allocate() to commit
+                return m_map + m_tail + m_used;
+            }
+
+        public:
+            char *allocate(size_t byte_count)
+            {
+                // returns nullptr if ring has not enough free space
+                // caller should release() records and retry
+
+                if(byte_count == 0 || byte_count > available()){
+                    return nullptr;
+                }
+
+                auto p = writable();
+                m_used += byte_count;
+                return p;
+            }
+
+            void release(size_t byte_count)
+            {
+                if(byte_count > m_used){
+                    throw fflerror("release %zu bytes, used: %zu", byte_count, m_used);
+                }
+
+                m_tail += byte_count;
+                m_used -= byte_count;
+
+                if(m_tail >= m_size){
+                    m_tail -= m_size;
+                }
+            }
+
+            void reset()
+            {
+                m_tail = 0;
+                m_used = 0;
+            }
+    };
+#endif
+
+    template<class T, size_t Alignment = alignof(std::max_align_t), class Arena = scoped_alloc::arena_interf<Alignment>> class allocator
+    {
+        // Arena can be an arena class hiding allocate()/deallocate() of arena_interf, i.e. recycle_arena
+
+        public:
+            using value_type = T;
+            template <class U, size_t A, class R> friend class scoped_alloc::allocator;
+
+        public:
+            template <class UpperType> struct rebind
+            {
+                using other = allocator<UpperType, Alignment, Arena>;
+            };
+
+        private:
+            Arena &m_arena;
+
+        public:
+            allocator(const allocator &) = default;
+            allocator &operator=(const allocator &) = delete;
+
+        public:
+            allocator(Arena &arena_ref) noexcept
+                : m_arena(arena_ref)
+            {}
+
+        public:
+            template<class U> allocator(const allocator<U, Alignment, Arena>& alloc_ref) noexcept
+                : m_arena(alloc_ref.m_arena)
+            {}
+
+        public:
+            T* allocate(size_t n)
+            {
+                return reinterpret_cast<T *>(m_arena.template allocate<alignof(T)>(n * sizeof(T)));
+            }
+
+            void deallocate(T *p, size_t n) noexcept
+            {
+                m_arena.deallocate(reinterpret_cast<char *>(p), n * sizeof(T));
+            }
+
+        public:
+            template<typename T2, size_t A2, class R2> bool operator == (const scoped_alloc::allocator<T2, A2, R2> &parm) const noexcept
+            {
+                return Alignment == A2 && static_cast<const void *>(&(this->m_arena)) == static_cast<const void *>(&(parm.m_arena));
+            }
+
+            template<typename T2, size_t A2, class R2> bool operator != (const scoped_alloc::allocator<T2, A2, R2> &parm) const noexcept
+            {
+                return !(*this == parm);
+            }
+    };
+
+    template<class T, size_t Alignment = alignof(std::max_align_t)> class arena_deleter
+    {
+        // deleter of allocate_unique()
+        // remembers byte count so unique_ptr<Derived> can convert to unique_ptr<Base>
+
+        public:
+            template <class U, size_t A> friend class scoped_alloc::arena_deleter;
+
+        private:
+            arena_interf<Alignment> *m_arena = nullptr;
+            size_t m_byte_count = 0;
+
+        public:
+            arena_deleter() noexcept = default;
+            arena_deleter(arena_interf<Alignment> &arena_ref, size_t byte_count) noexcept
+                : m_arena(&arena_ref)
+                , m_byte_count(byte_count)
+            {}
+
+        public:
+            template<class U, std::enable_if_t<std::is_convertible<U *, T *>::value, int> = 0> arena_deleter(const arena_deleter<U, Alignment> &deleter) noexcept
+                : m_arena(deleter.m_arena)
+                , m_byte_count(deleter.m_byte_count)
+            {}
+
+        public:
+            arena_interf<Alignment> *arena() const noexcept
+            {
+                return m_arena;
+            }
+
+        private:
+            static char *object_address(T *p, std::true_type) noexcept
+            {
+                // base subobject may not be at the start of allocated object
+                return static_cast<char *>(const_cast<void *>(dynamic_cast<const volatile void *>(p)));
+            }
+
+            static char *object_address(T *p, std::false_type) noexcept
+            {
+                return reinterpret_cast<char *>(const_cast<std::remove_cv_t<T> *>(p));
+            }
+
+        public:
+            void operator () (T *p) const noexcept
+            {
+                if(p){
+                    const auto buf = object_address(p, std::is_polymorphic<T>{});
+                    p->~T();
+                    m_arena->deallocate(buf, m_byte_count);
+                }
+            }
+    };
+
+    template<class T, size_t Alignment = alignof(std::max_align_t)> using arena_unique_ptr = std::unique_ptr<T, scoped_alloc::arena_deleter<T, Alignment>>;
+
+    template<class T, size_t Alignment, typename... Args> scoped_alloc::arena_unique_ptr<T, Alignment> allocate_unique(arena_interf<Alignment> &arena, Args && ... args)
+    {
+        // object comes from arena and gets returned to arena when unique_ptr goes away
+        // for shared ownership use std::allocate_shared with scoped_alloc::allocator, control block and object then take one allocation from arena
+        static_assert(!std::is_array<T>::value, "allocate_unique doesn't support array");
+
+        const auto p = arena.template allocate<alignof(T)>(sizeof(T));
+        try{
+            return scoped_alloc::arena_unique_ptr<T, Alignment>(new (p) T(std::forward<Args>(args)...), scoped_alloc::arena_deleter<T, Alignment>(arena, sizeof(T)));
+        }
+        catch(...){
+            arena.deallocate(p, sizeof(T));
+            throw;
+        }
+    }
+
+    template<class T, size_t Alignment = alignof(std::max_align_t)> class offset_allocator
+    {
+        // allocator with offset_ptr as pointer type
+        // containers honouring allocator pointer types, i.e. std::vector, then only store relocatable pointers
+        // their content can be used directly in an arena mapped at a different address, see file_arena
+        //
+        // NOTICE: the allocator itself still refers to the arena object of current process
+        // after relocation the container is valid for read, but don't allocate through it
+        //
+        // always use full width offset_ptr because containers keep pointers on stack temporarily
+        // narrow offset, i.e. offset_ptr<T, int32_t>, can't reach arena from stack
+        //
+        // libstdc++ node based containers, std::list, std::map etc, convert pointers to raw pointers internally
+        // they are not relocatable even with this allocator
+
+        public:
+            using value_type         = T;
+            using pointer            = scoped_alloc::offset_ptr<T>;
+            using const_pointer      = scoped_alloc::offset_ptr<const T>;
+            using void_pointer       = scoped_alloc::offset_ptr<void>;
+            using const_void_pointer = scoped_alloc::offset_ptr<const void>;
+            using size_type          = size_t;
+            using difference_type    = std::ptrdiff_t;
+
+        public:
+            template <class U, size_t A> friend class scoped_alloc::offset_allocator;
+
+        public:
+            template <class UpperType> struct rebind
+            {
+                using other = offset_allocator<UpperType, Alignment>;
+            };
+
+        private:
+            arena_interf<Alignment> &m_arena;
+
+        public:
+            offset_allocator(const offset_allocator &) = default;
+            offset_allocator &operator=(const offset_allocator &) = delete;
+
+        public:
+            offset_allocator(arena_interf<Alignment> &arena_ref) noexcept
+                : m_arena(arena_ref)
+            {}
+
+        public:
+            template<class U> offset_allocator(const offset_allocator<U, Alignment> &alloc_ref) noexcept
+                : m_arena(alloc_ref.m_arena)
+            {}
+
+        public:
+            pointer allocate(size_t n)
+            {
+                return pointer(reinterpret_cast<T *>(m_arena.template allocate<alignof(T)>(n * sizeof(T))));
+            }
+
+            void deallocate(pointer p, size_t n) noexcept
+            {
+                m_arena.deallocate(reinterpret_cast<char *>(p.get()), n * sizeof(T));
+            }
+
+        public:
+            template<typename T2, size_t A2> bool operator == (const scoped_alloc::offset_allocator<T2, A2> &parm) const noexcept
+            {
+                return Alignment == A2 && &(this->m_arena) == &(parm.m_arena);
+            }
+
+            template<typename T2, size_t A2> bool operator != (const scoped_alloc::offset_allocator<T2, A2> &parm) const noexcept
+            {
+                return !(*this == parm);
+            }
+    };
+
+    template<size_t Alignment = alignof(std::max_align_t)> scoped_alloc::arena_interf<Alignment> *&current_arena() noexcept
+    {
+        // current arena of this thread, set by arena_scope
+        static thread_local scoped_alloc::arena_interf<Alignment> *arena = nullptr;
+        return arena;
+    }
+
+    template<size_t Alignment = alignof(std::max_align_t)> class arena_scope
+    {
+        // make an arena current for this thread till end of scope
+        // scopes nest, destruction restores the previous current arena
+
+        private:
+            scoped_alloc::arena_interf<Alignment> * const m_prev;
+
+        public:
+            explicit arena_scope(scoped_alloc::arena_interf<Alignment> &arena) noexcept
+                : m_prev(scoped_alloc::current_arena<Alignment>())
+            {
+                scoped_alloc::current_arena<Alignment>() = &arena;
+            }
+
+            ~arena_scope()
+            {
+                scoped_alloc::current_arena<Alignment>() = m_prev;
+            }
+
+        public:
+            arena_scope(arena_scope &&) = delete;
+            arena_scope(const arena_scope &) = delete;
+            arena_scope &operator = (arena_scope &&) = delete;
+            arena_scope &operator = (const arena_scope &) = delete;
+    };
+
+    template<class T, size_t Alignment = alignof(std::max_align_t)> class local_allocator
+    {
+        // stateless allocator, resolves arena by arena_scope of current thread
+        // it's an empty class, containers using it get no size overhead by empty-base optimization
+        // all instances compare equal, containers move and swap by pointers only
+        //
+        // NOTICE: memory must be released when the same arena is current as it's allocated
+        //
+        //     scoped_alloc::dynamic_arena<> d(1024);
+        //     {
+        //         scoped_alloc::arena_scope<> scope(d);
+        //         std::vector<int, scoped_alloc::local_allocator<int>> v;
+        //
+        //         v.push_back(1);
+        //         ...
+        //     }
+
+        public:
+            using value_type = T;
+
+        public:
+            using is_always_equal = std::true_type;
+            using propagate_on_container_move_assignment = std::true_type;
+
+        public:
+            template <class UpperType> struct rebind
+            {
+                using other = local_allocator<UpperType, Alignment>;
+            };
+
+        public:
+            local_allocator() = default;
+
+        public:
+            template<class U> local_allocator(const local_allocator<U, Alignment> &) noexcept
+            {}
+
+        private:
+            static scoped_alloc::arena_interf<Alignment> *current_ex()
+            {
+                if(auto arena = scoped_alloc::current_arena<Alignment>()){
+                    return arena;
+                }
+
+#ifdef SCOPED_ALLOC_THROW_OVERLIVE
+                throw fflerror("no arena_scope for current thread");
+#else
+                assert(false && "no arena_scope for current thread");
+                return nullptr;
+#endif
+            }
+
+        public:
+            T* allocate(size_t n)
+            {
+                return reinterpret_cast<T *>(current_ex()->template allocate<alignof(T)>(n * sizeof(T)));
+            }
+
+            void deallocate(T *p, size_t n) noexcept
+            {
+                current_ex()->deallocate(reinterpret_cast<char *>(p), n * sizeof(T));
+            }
+
+        public:
+            template<typename T2, size_t A2> bool operator == (const scoped_alloc::local_allocator<T2, A2> &) const noexcept
+            {
+                return Alignment == A2;
+            }
+
+            template<typename T2, size_t A2> bool operator != (const scoped_alloc::local_allocator<T2, A2> &parm) const noexcept
+            {
+                return !(*this == parm);
+            }
+    };
+
+    template<size_t Alignment = alignof(std::max_align_t)> struct arena_promise
+    {
+        // promise type mixin, coroutine frames come from arena instead of heap
+        // arena is either given explicitly by std::allocator_arg, or the current arena of arena_scope
+        // frame falls back to heap if neither is available
+        //
+        //     struct task
+        //     {
+        //         struct promise_type: scoped_alloc::arena_promise<>
+        //         {
+        //             ...
+        //         };
+        //     };
+        //
+        //     task handle(std::allocator_arg_t, scoped_alloc::arena_interf<> &, request);              // explicit arena
+        //     task handle(request);                                                                    // current arena
+        //
+        // arena pointer is stored in a small header in front of the frame
+        // frame is released to the same arena even if another arena_scope is current when coroutine finishes
+        //
+        // NOTICE: gcc-12 may give false -Wmismatched-new-delete for coroutines using explicit arena
+        // coroutine frame is always released by the usual operator delete, which handles both cases
+
+        private:
+            struct frame_header
+            {
+                scoped_alloc::arena_interf<Alignment> *arena;
+            };
+
+        private:
+            static size_t header_size() noexcept
+            {
+                return scoped_alloc::aligned_size<Alignment>(sizeof(frame_header));
+            }
+
+            static void *alloc_frame(scoped_alloc::arena_interf<Alignment> *arena, size_t byte_count)
+            {
+                const auto total = header_size() + byte_count;
+                const auto p = arena ? arena->template allocate<Alignment>(total) : scoped_alloc::alloc_aligned<Alignment>(total).buf;
+
+                new (p) frame_header{arena};
+                return p + header_size();
+            }
+
+        public:
+            static void *operator new(size_t byte_count)
+            {
+                return alloc_frame(scoped_alloc::current_arena<Alignment>(), byte_count);
+            }
+
+            template<typename... Args> static void *operator new(size_t byte_count, std::allocator_arg_t, scoped_alloc::arena_interf<Alignment> &arena, Args && ...)
+            {
+                return alloc_frame(&arena, byte_count);
+            }
+
+            template<typename Self, typename... Args> static void *operator new(size_t byte_count, Self &&, std::allocator_arg_t, scoped_alloc::arena_interf<Alignment> &arena, Args && ...)
+            {
+                // member function coroutine, object parameter comes first
+                return alloc_frame(&arena, byte_count);
+            }
+
+        public:
+            static void operator delete(void *frame, size_t byte_count) noexcept
+            {
+                const auto p = static_cast<char *>(frame) - header_size();
+                if(const auto arena = reinterpret_cast<frame_header *>(p)->arena){
+                    arena->deallocate(p, header_size() + byte_count);
+                }
+
+                else{
+                    scoped_alloc::free_aligned(p);
+                }
+            }
+    };
+
+    template<typename T> T *to_address(T *p) noexcept
+    {
+        return p;
+    }
+
+    template<typename T, typename O> T *to_address(const scoped_alloc::offset_ptr<T, O> &p) noexcept
+    {
+        return p.get();
+    }
+
+    template<size_t Alignment = alignof(std::max_align_t)> class arena_table
+    {
+        // process wide table of arenas, an arena is referred by its index
+        // lookup is lock-free, add/remove scan the table and are not expected on hot path
+
+        public:
+            constexpr static size_t capacity = 65536;
+
+        private:
+            static std::atomic<scoped_alloc::arena_interf<Alignment> *> *slots() noexcept
+            {
+                static std::atomic<scoped_alloc::arena_interf<Alignment> *> s_slots[capacity];
+                return s_slots;
+            }
+
+        public:
+            static size_t add(scoped_alloc::arena_interf<Alignment> &arena)
+            {
+                for(size_t i = 0; i < capacity; ++i){
+                    scoped_alloc::arena_interf<Alignment> *expected = nullptr;
+                    if(slots()[i].compare_exchange_strong(expected, &arena)){
+                        return i;
+                    }
+                }
+                throw fflerror("arena_table is full");
+            }
+
+            static void add(scoped_alloc::arena_interf<Alignment> &arena, size_t index)
+            {
+                // register with given index
+                // i.e. arena mapped in a restarted process takes the index it used to have
+
+                scoped_alloc::arena_interf<Alignment> *expected = nullptr;
+                if(index >= capacity || !slots()[index].compare_exchange_strong(expected, &arena)){
+                    throw fflerror("arena_table index %zu is not available", index);
+                }
+            }
+
+            static void remove(size_t index) noexcept
+            {
+                if(index < capacity){
+                    slots()[index].store(nullptr, std::memory_order_release);
+                }
+            }
+
+            static scoped_alloc::arena_interf<Alignment> *get(size_t index) noexcept
+            {
+                return slots()[index].load(std::memory_order_acquire);
+            }
+    };
+
+    template<size_t Alignment = alignof(std::max_align_t)> class arena_registration
+    {
+        // register an arena to arena_table till end of scope
+
+        private:
+            const size_t m_index;
+
+        public:
+            explicit arena_registration(scoped_alloc::arena_interf<Alignment> &arena)
+                : m_index(scoped_alloc::arena_table<Alignment>::add(arena))
+            {}
+
+            arena_registration(scoped_alloc::arena_interf<Alignment> &arena, size_t index)
+                : m_index(index)
+            {
+                scoped_alloc::arena_table<Alignment>::add(arena, index);
+            }
+
+            ~arena_registration()
+            {
+                scoped_alloc::arena_table<Alignment>::remove(m_index);
+            }
+
+        public:
+            arena_registration(arena_registration &&) = delete;
+            arena_registration(const arena_registration &) = delete;
+            arena_registration &operator = (arena_registration &&) = delete;
+            arena_registration &operator = (const arena_registration &) = delete;
+
+        public:
+            size_t index() const
+            {
+                return m_index;
+            }
+    };
+
+    template<class T, size_t Alignment = alignof(std::max_align_t), typename IndexType = uint16_t, typename VoidPointer = void *> class index_allocator
+    {
+        // allocator refers to arena by a compact index into arena_table instead of a reference
+        // index stays valid across processes and restarts if the arena registers with the same index
+        //
+        // with VoidPointer = offset_ptr<void> container content is fully relocatable
+        // it can still allocate after the arena gets mapped at a different address, unlike offset_allocator
+        //
+        // std containers keep allocator in a pointer-aligned slot, compact index saves no space there
+        // use the index and narrow offset_ptr, i.e. offset_ptr<node, int32_t>, in pointer-heavy user structures
+
+        private:
+            static_assert(std::is_integral<IndexType>::value && std::is_unsigned<IndexType>::value, "bad index type");
+
+        public:
+            using value_type         = T;
+            using pointer            = typename std::pointer_traits<VoidPointer>::template rebind<T>;
+            using const_pointer      = typename std::pointer_traits<VoidPointer>::template rebind<const T>;
+            using void_pointer       = VoidPointer;
+            using const_void_pointer = typename std::pointer_traits<VoidPointer>::template rebind<const void>;
+            using size_type          = size_t;
+            using difference_type    = std::ptrdiff_t;
+
+        public:
+            template <class U, size_t A, typename I, typename V> friend class scoped_alloc::index_allocator;
+
+        public:
+            template <class UpperType> struct rebind
+            {
+                using other = index_allocator<UpperType, Alignment, IndexType, VoidPointer>;
+            };
+
+        private:
+            IndexType m_index;
+
+        public:
+            index_allocator(const index_allocator &) = default;
+            index_allocator &operator=(const index_allocator &) = delete;
+
+        public:
+            index_allocator(size_t index)
+                : m_index(static_cast<IndexType>(index))
+            {
+                if(index != m_index || index >= scoped_alloc::arena_table<Alignment>::capacity){
+                    throw fflerror("arena index %zu exceeds index type", index);
+                }
+            }
+
+            index_allocator(const scoped_alloc::arena_registration<Alignment> &reg)
+                : index_allocator(reg.index())
+            {}
+
+        public:
+            template<class U> index_allocator(const index_allocator<U, Alignment, IndexType, VoidPointer> &alloc_ref) noexcept
+                : m_index(alloc_ref.m_index)
+            {}
+
+        private:
+            scoped_alloc::arena_interf<Alignment> &arena() const
+            {
+                if(auto p = scoped_alloc::arena_table<Alignment>::get(m_index)){
+                    return *p;
+                }
+
+#ifdef SCOPED_ALLOC_THROW_OVERLIVE
+                throw fflerror("no arena registered with index %zu", static_cast<size_t>(m_index));
+#else
+                assert(false && "no arena registered with the index");
+                return *static_cast<scoped_alloc::arena_interf<Alignment> *>(nullptr);
+#endif
+            }
+
+        public:
+            pointer allocate(size_t n)
+            {
+                return pointer(reinterpret_cast<T *>(arena().template allocate<alignof(T)>(n * sizeof(T))));
+            }
+
+            void deallocate(pointer p, size_t n) noexcept
+            {
+                arena().deallocate(reinterpret_cast<char *>(scoped_alloc::to_address(p)), n * sizeof(T));
+            }
+
+        public:
+            template<typename T2, size_t A2, typename I2, typename V2> bool operator == (const scoped_alloc::index_allocator<T2, A2, I2, V2> &parm) const noexcept
+            {
+                return Alignment == A2 && m_index == parm.m_index;
+            }
+
+            template<typename T2, size_t A2, typename I2, typename V2> bool operator != (const scoped_alloc::index_allocator<T2, A2, I2, V2> &parm) const noexcept
+            {
+                return !(*this == parm);
+            }
+    };
+
+    template<class T, size_t Alignment = alignof(std::max_align_t)> class monotonic_allocator
+    {
+        // allocator never gives memory back to arena buffer, deallocate() is no-op for it
+        // memory from fallback dynamic_alloc() is still released
+        // arena buffer gets reclaimed by reset() as a whole, see wink_out()
+
+        public:
+            using value_type = T;
+            template <class U, size_t A> friend class scoped_alloc::monotonic_allocator;
+
+        public:
+            template <class UpperType> struct rebind
+            {
+                using other = monotonic_allocator<UpperType, Alignment>;
+            };
+
+        private:
+            arena_interf<Alignment> &m_arena;
+
+        public:
+            monotonic_allocator(const monotonic_allocator &) = default;
+            monotonic_allocator &operator=(const monotonic_allocator &) = delete;
+
+        public:
+            monotonic_allocator(arena_interf<Alignment> &arena_ref) noexcept
+                : m_arena(arena_ref)
+            {}
+
+        public:
+            template<class U> monotonic_allocator(const monotonic_allocator<U, Alignment> &alloc_ref) noexcept
+                : m_arena(alloc_ref.m_arena)
+            {}
+
+        public:
+            T* allocate(size_t n)
+            {
+                return reinterpret_cast<T *>(m_arena.template allocate<alignof(T)>(n * sizeof(T)));
+            }
+
+            void deallocate(T *p, size_t n) noexcept
+            {
+                if(!m_arena.owns(reinterpret_cast<char *>(p))){
+                    m_arena.deallocate(reinterpret_cast<char *>(p), n * sizeof(T));
+                }
+            }
+
+        public:
+            template<typename T2, size_t A2> bool operator == (const scoped_alloc::monotonic_allocator<T2, A2> &parm) const noexcept
+            {
+                return Alignment == A2 && &(this->m_arena) == &(parm.m_arena);
+            }
+
+            template<typename T2, size_t A2> bool operator != (const scoped_alloc::monotonic_allocator<T2, A2> &parm) const noexcept
+            {
+                return !(*this == parm);
+            }
+    };
+
+    template<typename Key, typename Value, size_t Alignment = alignof(std::max_align_t), typename KeyHash = std::hash<Key>, typename KeyEq = std::equal_to<Key>> class hash_wrapper
+    {
+        private:
+            scoped_alloc::dynamic_arena<Alignment> m_arena;
+
+        private:
+            scoped_alloc::arena_profile *m_profile = nullptr;
+            std::string m_name;
 
         public:
             std::unordered_map<Key, Value, KeyHash, KeyEq, scoped_alloc::allocator<std::pair<const Key, Value>, Alignment>> c;
@@ -540,6 +4108,37 @@ namespace scoped_alloc
                 alloc(n);
             }
 
+        public:
+            hash_wrapper(scoped_alloc::arena_profile &profile, std::string name, size_t n): hash_wrapper()
+            {
+                // buffer sized by profile if it has name, otherwise estimated from n
+                // demand is recorded back to profile when destroyed
+                m_profile = &profile;
+                m_name = std::move(name);
+
+                if(const auto byte_count = m_profile->size_hint(m_name, 0)){
+                    m_arena.alloc(byte_count);
+                    c.reserve(n);
+                }
+
+                else{
+                    alloc(n);
+                }
+            }
+
+        public:
+            ~hash_wrapper()
+            {
+                if(m_profile){
+                    try{
+                        m_profile->record(m_name, m_arena.demand());
+                    }
+                    catch(...){
+                        // profile is only a hint
+                    }
+                }
+            }
+
         public:
             void alloc(size_t n)
             {
@@ -630,4 +4229,298 @@ namespace scoped_alloc
                 return BufSize;
             }
     };
+
+    template<size_t Alignment = alignof(std::max_align_t)> class msg_builder
+    {
+        // build length-prefixed message directly in arena buffer, one pass without intermediate copy
+        //
+        // wire format: field is a uint32_t length, padded to Alignment, followed by payload padded to Alignment
+        //              nested message is a field whose payload is a sequence of fields, its length gets back-patched
+        //
+        // output is contiguous only if nobody else allocates from the arena during building
+        // builder throws if it detects its bytes are not contiguous
+
+        private:
+            scoped_alloc::arena_interf<Alignment> &m_arena;
+
+        private:
+            char  *m_begin = nullptr;
+            size_t m_size  = 0;
+
+        public:
+            msg_builder(scoped_alloc::arena_interf<Alignment> &arena)
+                : m_arena(arena)
+            {}
+
+        private:
+            static size_t header_size()
+            {
+                return scoped_alloc::aligned_size<Alignment>(sizeof(uint32_t));
+            }
+
+            static void check_length(size_t byte_count)
+            {
+                if(byte_count > UINT32_MAX){
+                    throw fflerror("field length exceeds uint32_t: %zu", byte_count);
+                }
+            }
+
+            static void write_length(char *p, size_t byte_count)
+            {
+                check_length(byte_count);
+                const auto length = static_cast<uint32_t>(byte_count);
+                std::memcpy(p, &length, sizeof(length));
+            }
+
+            char *append(size_t byte_count)
+            {
+                auto p = m_arena.template allocate<Alignment>(byte_count);
+                if(!m_begin){
+                    m_begin = p;
+                }
+
+                else if(p != m_begin + m_size){
+                    m_arena.deallocate(p, byte_count);
+                    throw fflerror("message is not contiguous: arena has other allocation or runs out of buffer");
+                }
+
+                m_size += scoped_alloc::aligned_size<Alignment>(byte_count);
+                return p;
+            }
+
+        public:
+            void add(const void *data, size_t byte_count)
+            {
+                // check before append, no half written field on failure
+                check_length(byte_count);
+
+                const auto field_size = header_size() + byte_count;
+                const auto p = append(field_size);
+
+                write_length(p, byte_count);
+                std::memset(p + sizeof(uint32_t), 0, header_size() - sizeof(uint32_t));
+
+                if(byte_count){
+                    std::memcpy(p + header_size(), data, byte_count);
+                }
+                std::memset(p + field_size, 0, scoped_alloc::aligned_size<Alignment>(field_size) - field_size);
+            }
+
+            template<typename T> void add_value(const T &t)
+            {
+                static_assert(std::is_trivially_copyable<T>::value, "field type is not trivially copyable");
+                add(&t, sizeof(t));
+            }
+
+        public:
+            size_t begin_msg()
+            {
+                // returns marker for end_msg()
+                // length is unknown now, back-patched by end_msg()
+
+                const auto p = append(header_size());
+                std::memset(p, 0, header_size());
+                return static_cast<size_t>(p - m_begin);
+            }
+
+            void end_msg(size_t marker)
+            {
+                if(!m_begin || marker + header_size() > m_size){
+                    throw fflerror("invalid message marker: %zu", marker);
+                }
+                write_length(m_begin + marker, m_size - marker - header_size());
+            }
+
+        public:
+            const char *data() const
+            {
+                return m_begin;
+            }
+
+            size_t size() const
+            {
+                return m_size;
+            }
+
+        public:
+            void release()
+            {
+                // give bytes back to arena
+                // only recycled if the message is on top of the arena
+
+                if(m_begin){
+                    m_arena.deallocate(m_begin, m_size);
+                }
+
+                m_begin = nullptr;
+                m_size  = 0;
+            }
+    };
+
+    template<size_t Alignment> void alloc_measured(scoped_alloc::dynamic_arena<Alignment> &arena, const scoped_alloc::measure_arena<Alignment> &measure)
+    {
+        // size arena by measuring pass of rebuild()/relayout()
+        // always attach a buffer, empty container still needs one to grow
+        arena.alloc(std::max<size_t>(measure.measured(), Alignment));
+    }
+
+    template<typename Container, size_t Alignment> Container rebuild(const Container &c, scoped_alloc::dynamic_arena<Alignment> &arena)
+    {
+        // copy container into arena without buffer attached
+        // a measuring pass sizes the buffer, then elements are copied into it sequentially
+        //
+        //     scoped_alloc::dynamic_arena<> a(1024 * 1024);
+        //     auto m = std::make_unique<map_type>(a);
+        //     ...                                      // many insert/erase leave dead space in a
+        //
+        //     scoped_alloc::dynamic_arena<> b;
+        //     auto m2 = scoped_alloc::rebuild(std::move(*m), b);
+        //
+        //     m.reset();                               // old container must be destroyed first
+        //     a.release();                             // then release the old buffer
+
+        using allocator_type = typename Container::allocator_type;
+        if(arena.has_buf()){
+            throw fflerror("dynamic_arena has buffer attached");
+        }
+
+        scoped_alloc::measure_arena<Alignment> measure;
+        {
+            Container probe(c, allocator_type(measure));
+        }
+
+        scoped_alloc::alloc_measured(arena, measure);
+        return Container(c, allocator_type(arena));
+    }
+
+    template<typename Container, size_t Alignment, typename = std::enable_if_t<!std::is_lvalue_reference<Container>::value>> Container rebuild(Container &&c, scoped_alloc::dynamic_arena<Alignment> &arena)
+    {
+        // move version, elements are moved twice and never copied
+        // first into the measuring arena, then into the sized buffer
+
+        using allocator_type = typename Container::allocator_type;
+        if(arena.has_buf()){
+            throw fflerror("dynamic_arena has buffer attached");
+        }
+
+        scoped_alloc::measure_arena<Alignment> measure;
+        Container probe(std::move(c), allocator_type(measure));
+
+        scoped_alloc::alloc_measured(arena, measure);
+        return Container(std::move(probe), allocator_type(arena));
+    }
+
+    template<typename Container, typename = void> struct has_key_compare: std::false_type {};
+    template<typename Container> struct has_key_compare<Container, std::conditional_t<true, void, typename Container::key_compare>>: std::true_type {};
+
+    template<typename Container, typename Iterator> Container relayout_copy(Iterator begin, Iterator end, const Container &c, const typename Container::allocator_type &alloc, std::true_type)
+    {
+        // ordered associative container, insert in traversal order with end() as hint
+        // nodes get allocated in the same order as in-order iteration
+
+        Container r(c.key_comp(), alloc);
+        for(; begin != end; ++begin){
+            r.emplace_hint(r.end(), *begin);
+        }
+        return r;
+    }
+
+    template<typename Container, typename Iterator> Container relayout_copy(Iterator begin, Iterator end, const Container &, const typename Container::allocator_type &alloc, std::false_type)
+    {
+        // sequence container, i.e. std::list, std::deque
+        Container r(alloc);
+        for(; begin != end; ++begin){
+            r.emplace_back(*begin);
+        }
+        return r;
+    }
+
+    template<typename Container, size_t Alignment> Container relayout(const Container &c, scoped_alloc::dynamic_arena<Alignment> &arena)
+    {
+        // rebuild node based container into arena without buffer attached
+        // nodes are laid out sequentially in traversal order, iteration then walks the buffer forward
+        //
+        // copy by rebuild() follows the internal order of the container
+        // i.e. libstdc++ copies std::map in pre-order, not in-order
+        //
+        // unordered containers have no traversal order to follow, use rebuild()
+
+        using allocator_type = typename Container::allocator_type;
+        using is_associative = scoped_alloc::has_key_compare<Container>;
+
+        if(arena.has_buf()){
+            throw fflerror("dynamic_arena has buffer attached");
+        }
+
+        scoped_alloc::measure_arena<Alignment> measure;
+        {
+            scoped_alloc::relayout_copy(c.begin(), c.end(), c, allocator_type(measure), is_associative());
+        }
+
+        scoped_alloc::alloc_measured(arena, measure);
+        return scoped_alloc::relayout_copy(c.begin(), c.end(), c, allocator_type(arena), is_associative());
+    }
+
+    template<typename Container, size_t Alignment, typename = std::enable_if_t<!std::is_lvalue_reference<Container>::value>> Container relayout(Container &&c, scoped_alloc::dynamic_arena<Alignment> &arena)
+    {
+        // move version, elements are moved twice and never copied
+        // keys of associative containers are const and still get copied
+
+        using allocator_type = typename Container::allocator_type;
+        using is_associative = scoped_alloc::has_key_compare<Container>;
+
+        if(arena.has_buf()){
+            throw fflerror("dynamic_arena has buffer attached");
+        }
+
+        scoped_alloc::measure_arena<Alignment> measure;
+        auto probe = scoped_alloc::relayout_copy(std::make_move_iterator(c.begin()), std::make_move_iterator(c.end()), c, allocator_type(measure), is_associative());
+
+        scoped_alloc::alloc_measured(arena, measure);
+        return scoped_alloc::relayout_copy(std::make_move_iterator(probe.begin()), std::make_move_iterator(probe.end()), probe, allocator_type(arena), is_associative());
+    }
+
+    template<typename Container, typename = void> struct has_hasher: std::false_type {};
+    template<typename Container> struct has_hasher<Container, std::conditional_t<true, void, typename Container::hasher>>: std::true_type {};
+
+    template<typename Container> void wink_out_renew(Container &c, std::true_type, std::false_type)
+    {
+        const auto comp  = c.key_comp();
+        const auto alloc = c.get_allocator();
+        new (std::addressof(c)) Container(comp, alloc);
+    }
+
+    template<typename Container> void wink_out_renew(Container &c, std::false_type, std::true_type)
+    {
+        const auto hash  = c.hash_function();
+        const auto eq    = c.key_eq();
+        const auto alloc = c.get_allocator();
+        new (std::addressof(c)) Container(0, hash, eq, alloc);
+    }
+
+    template<typename Container> void wink_out_renew(Container &c, std::false_type, std::false_type)
+    {
+        const auto alloc = c.get_allocator();
+        new (std::addressof(c)) Container(alloc);
+    }
+
+    template<typename Container> void wink_out(Container &c)
+    {
+        // abandon storage of container without tearing down its nodes one by one
+        // container is re-created empty in place, old storage gets reclaimed when arena resets
+        //
+        // valid only if:
+        //     1. elements are trivially destructible
+        //     2. all storage comes from arena buffer, memory from fallback dynamic_alloc() leaks
+        //
+        //     scoped_alloc::dynamic_arena<> d(64 * 1024 * 1024);
+        //     std::map<int, int, std::less<int>, scoped_alloc::monotonic_allocator<std::pair<const int, int>>> m(d);
+        //     ...
+        //
+        //     scoped_alloc::wink_out(m);   // O(1), no node visited
+        //     d.reset();
+
+        static_assert(std::is_trivially_destructible<typename Container::value_type>::value, "wink_out skips element destructor");
+        scoped_alloc::wink_out_renew(c, scoped_alloc::has_key_compare<Container>(), scoped_alloc::has_hasher<Container>());
+    }
 }